@@ -0,0 +1,72 @@
+@--------------------------------------------------------------------------------
+@ spanfill16.s
+@--------------------------------------------------------------------------------
+@ Fills a horizontal span of 16-bit pixels (Mode 5/Mode 3 scanlines); replaces
+@ memset16 in the span fillers of the rasteriser, cf. source/render/spanfill.h
+@--------------------------------------------------------------------------------
+
+@ r0: the destination / r1: the colour (lower halfword) / r2: the number of pixels
+@ Most spans of our triangles are short (10 to 60 pixels), so we avoid the
+@ generic setup of memset16: We store one halfword to reach a word boundary,
+@ then 16 pixels per STMIA (8 registers), and the remaining 0 to 15 pixels
+@ by jumping into an unrolled sequence of word stores.
+    .syntax unified
+    .section .iwram, "ax", %progbits
+    .align 2
+    .arm
+    .global spanFill16
+    .type spanFill16 STT_FUNC
+spanFill16:
+    @ Return for empty spans, and put the colour into both halfwords of r1
+    cmp     r2, #0
+    bxle    lr
+    mov     r1, r1, lsl #16
+    orr     r1, r1, r1, lsr #16
+
+    @ Align the destination to a word
+    tst     r0, #2
+    beq     .Laligned
+    strh    r1, [r0], #2
+    subs    r2, r2, #1
+    bxeq    lr
+.Laligned:
+
+    @ Short spans go straight to the jump table
+    cmp     r2, #16
+    blt     .Lshort
+
+    @ Bulk: 8 registers (16 pixels) per store
+    stmfd   sp!, {r4-r8}
+    mov     r3, r1
+    mov     r4, r1
+    mov     r5, r1
+    mov     r6, r1
+    mov     r7, r1
+    mov     r8, r1
+    mov     r12, r1
+    sub     r2, r2, #16
+.Lbulk:
+    stmia   r0!, {r1, r3-r8, r12}
+    subs    r2, r2, #16
+    bge     .Lbulk
+    add     r2, r2, #16     @ 0 to 15 pixels left
+    ldmfd   sp!, {r4-r8}
+
+.Lshort:
+    @ Jump to the (7 - words)th store below (pc is two instructions ahead)
+    mov     r3, r2, lsr #1
+    rsb     r3, r3, #7
+    add     pc, pc, r3, lsl #2
+    nop
+    str     r1, [r0], #4
+    str     r1, [r0], #4
+    str     r1, [r0], #4
+    str     r1, [r0], #4
+    str     r1, [r0], #4
+    str     r1, [r0], #4
+    str     r1, [r0], #4
+
+    @ And the odd pixel at the end, if any
+    tst     r2, #1
+    strhne  r1, [r0]
+    bx      lr
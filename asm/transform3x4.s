@@ -0,0 +1,131 @@
+@--------------------------------------------------------------------------------
+@ transform3x4.s
+@--------------------------------------------------------------------------------
+@ Transforms a batch of vertices by a Matrix3x4 and computes their near/far
+@ outcodes in the same pass; cf. vecTransformBatch3x4 and
+@ vecTransformPackedBatch3x4 (16-bit input) in source/math.h
+@--------------------------------------------------------------------------------
+
+@ r0: the matrix / r1: the input vertices / r2: the output vertices /
+@ r3: the outcodes / [sp]: the number of vertices / [sp, #4]: the stride of the
+@ input (in vertices) / [sp, #8]: near / [sp, #12]: far
+@ The arithmetic is exactly the one of vecTransformed3x4: Each row is summed up
+@ in 64 bits (SMULL, 2x SMLAL), shifted back to .8 and the translation added.
+@ ARM mode has 14 registers we can use, and the vertex (3), the 64-bit sum (2),
+@ the pointers and the stride (4) take 9 of them, so only one row of the matrix
+@ (and a pointer to the next one) fits: We copy the matrix to the stack (IWRAM)
+@ as three rows of (a, b, c, translation), followed by -near, -far and the end
+@ of the outcodes, and load one row per LDM (5 cycles) while the vertex stays
+@ in registers.
+@ A Vec3 is read with a single LDM as well, which is sequential on the
+@ cartridge bus (most of our vertices come from ROM); a PackedVec3 is read
+@ (and sign-extended) with three LDRSH, i.e. half the bytes.
+@ The vertex goes into Rs of the multiplications, as the multiplier terminates
+@ early for small values (the .16 entries of the matrix are larger).
+
+#define ROW_SIZE 16
+#define BLOCK_NEAR (3 * ROW_SIZE)
+#define BLOCK_SIZE (BLOCK_NEAR + 12)
+#define SAVED_REGS_SIZE 36
+
+@ The outcode bits, cf. VERTEX_OUTCODE_NEAR/VERTEX_OUTCODE_FAR in source/math.h
+#define OUTCODE_NEAR 1
+#define OUTCODE_FAR 2
+
+    .syntax unified
+
+@ One row of the matrix: r7 = a * x + b * y + c * z (.16, shifted back to .8) + translation
+.macro TRANSFORM_ROW
+    ldmia   lr!, {r9-r12}
+    smull   r7, r8, r9, r4
+    smlal   r7, r8, r10, r5
+    smlal   r7, r8, r11, r6
+    mov     r7, r7, lsr #16
+    orr     r7, r7, r8, lsl #16
+    add     r7, r7, r12
+    str     r7, [r1], #4
+.endm
+
+@ The function for Vec3 (packed = 0) or PackedVec3 (packed = 1) input
+.macro TRANSFORM_BATCH name, packed
+    .section .iwram, "ax", %progbits
+    .align 2
+    .arm
+    .global \name
+    .type \name STT_FUNC
+\name:
+    stmfd   sp!, {r4-r11, lr}
+    sub     sp, sp, #BLOCK_SIZE
+
+    @ The rows of the matrix (Matrix3x4: linear[9], then the translation)
+    ldmia   r0, {r4-r12}
+    ldr     lr, [r0, #36]
+    stmia   sp, {r4-r6, lr}
+    ldr     lr, [r0, #40]
+    add     r4, sp, #ROW_SIZE
+    stmia   r4, {r7-r9, lr}
+    ldr     lr, [r0, #44]
+    add     r4, sp, #(2 * ROW_SIZE)
+    stmia   r4, {r10-r12, lr}
+
+    @ The arguments on the stack: count, stride, near, far
+    add     r12, sp, #(BLOCK_SIZE + SAVED_REGS_SIZE)
+    ldmia   r12, {r4-r7}
+    rsb     r6, r6, #0
+    rsb     r7, r7, #0
+    add     r8, r3, r4      @ The end of the outcodes
+    add     r12, sp, #BLOCK_NEAR
+    stmia   r12, {r6-r8}
+
+    @ The bytes to skip after each vertex: (stride - 1) * 12 (or * 6 if packed)
+    sub     r5, r5, #1
+    add     r5, r5, r5, lsl #1
+.if \packed
+    mov     r5, r5, lsl #1
+.else
+    mov     r5, r5, lsl #2
+.endif
+
+    @ r0: in, r1: out, r2: outcodes, r3: skip, lr: the rows
+    mov     r0, r1
+    mov     r1, r2
+    mov     r2, r3
+    mov     r3, r5
+    mov     lr, sp
+    cmp     r4, #0
+    ble     1f
+
+0:
+.if \packed
+    ldrsh   r4, [r0], #2    @ x, y, z
+    ldrsh   r5, [r0], #2
+    ldrsh   r6, [r0], #2
+.else
+    ldmia   r0!, {r4-r6}    @ x, y, z
+.endif
+    add     r0, r0, r3
+
+    TRANSFORM_ROW           @ x'
+    TRANSFORM_ROW           @ y'
+    TRANSFORM_ROW           @ z'
+
+    @ The outcode: Behind the near plane if z' > -near, beyond the far plane if z' < -far
+    ldmia   lr, {r9-r11}
+    sub     lr, lr, #BLOCK_NEAR
+    mov     r8, #0
+    cmp     r7, r9
+    movgt   r8, #OUTCODE_NEAR
+    cmp     r7, r10
+    orrlt   r8, r8, #OUTCODE_FAR
+    strb    r8, [r2], #1
+    cmp     r2, r11
+    blo     0b
+
+1:
+    add     sp, sp, #BLOCK_SIZE
+    ldmfd   sp!, {r4-r11, lr}
+    bx      lr
+.endm
+
+    TRANSFORM_BATCH vecTransformBatch3x4, 0
+    TRANSFORM_BATCH vecTransformPackedBatch3x4, 1
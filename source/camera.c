@@ -32,12 +32,8 @@ Camera cameraNew(Vec3 pos, FIXED fov, FIXED near, FIXED far, int mode)
             h = M5_SCALED_H;
         break;
     }
-    new.canvasWidth = int2fx(w);
-    new.canvasHeight = int2fx(h);
-    new.viewportWidth = float2fx(w / 100.f);
-    new.viewportHeight = float2fx(h / 100.f);
-    new.aspect = fxdiv(new.viewportWidth, new.viewportHeight);
     new.fov = fov;
+    assertion(near > 0 && far > near, "camera.c: 0 < near < far"); // The perspective divide (cf. fxReciprocal) relies on the near plane culling z <= 0.
     new.near = near;
     new.far = far;
     matrix4x4setIdentity(new.cam2world);
@@ -48,10 +44,21 @@ Camera cameraNew(Vec3 pos, FIXED fov, FIXED near, FIXED far, int mode)
     new.pitch = int2fx12(0);
     new.roll = int2fx12(0);
     new.lookAt = (Vec3){.x=0, .y=0, .z=0};
-    cameraComputePerspectiveMatrix(&new);
+    cameraSetCanvas(&new, w, h);
     return new;
 }
 
+void cameraSetCanvas(Camera *cam, int width, int height) 
+{
+    // The (vertical) field of view always spans the height of the canvas, so a lower render resolution (cf. drawSetResolution) shows the same image with fewer pixels. 
+    cam->canvasWidth = int2fx(width);
+    cam->canvasHeight = int2fx(height);
+    cam->viewportWidth = fxdiv(int2fx(width), int2fx(height));
+    cam->viewportHeight = int2fx(1);
+    cam->aspect = fxdiv(cam->viewportWidth, cam->viewportHeight);
+    cameraComputePerspectiveMatrix(cam);
+}
+
 
 static void cameraComputeRotMatrix(Camera *cam, FIXED result[16]) 
 {
@@ -141,4 +148,9 @@ void cameraComputePerspectiveMatrix(Camera *cam)
 
     cam->viewportTransFacY = viewport2image[5];
     cam->viewportTransAddY = viewport2image[7];
+
+    // A point is within the right plane if perspFacX * x <= -z (i.e. it's projected onto the canvas, cf. modelInstancesPrepareDraw), the other planes are analogous.
+    const float lenX = sqrt(fx2float(cam->perspFacX) * fx2float(cam->perspFacX) + 1.), lenY = sqrt(fx2float(cam->perspFacY) * fx2float(cam->perspFacY) + 1.);
+    cam->frustumRight = (Vec3){.x=float2fx(fx2float(cam->perspFacX) / lenX), .y=0, .z=float2fx(1. / lenX)};
+    cam->frustumTop = (Vec3){.x=0, .y=float2fx(fx2float(cam->perspFacY) / lenY), .z=float2fx(1. / lenY)};
 }
\ No newline at end of file
@@ -11,6 +11,7 @@ typedef struct Camera {
     FIXED perspMat[16];
     FIXED viewport2imageMat[16];
     FIXED perspFacX, perspFacY, viewportTransFacX, viewportTransFacY, viewportTransAddX, viewportTransAddY;
+    Vec3 frustumRight, frustumTop; // The outward (unit) normals of the right and top planes of the view frustum in camera space; the left and bottom ones are mirrored.
     FIXED cam2world[16]; 
     FIXED world2cam[16];
     Vec3 pos;
@@ -24,6 +25,8 @@ typedef struct Camera {
 } ALIGN4 Camera;
 
 Camera cameraNew(Vec3 pos, FIXED fov, FIXED near, FIXED far, int mode);
+/* Adapts the projection to a canvas of the given size (in pixels); drawBefore calls it if the render resolution changed. */
+void cameraSetCanvas(Camera *cam, int width, int height);
 IWRAM_CODE_ARM void cameraComputePerspectiveMatrix(Camera *cam);
 IWRAM_CODE_ARM void cameraComputeWorldToCamSpace(Camera *cam);
 
@@ -1,6 +1,7 @@
 #include "globals.h"
 
 int g_mode = DCNT_MODE5;
+int g_canvasWidth = M5_SCALED_W, g_canvasHeight = M5_SCALED_H;
 
 Timer g_timer;
 int g_frameCount;
@@ -5,8 +5,14 @@
 #include "timer.h"
 
 // #define DEBUG_PRINT
+// #define SPANFILL_BENCHMARK // Prints a microbenchmark of the span fillers on startup, cf. render/spanfill.h
+// #define TRANSFORM_BENCHMARK // Prints a microbenchmark of the vertex transforms on startup, cf. vecTransformBatch3x4 in math.h
+// #define SLOPE_LUT_CHECK // Checks on startup that the reciprocal LUT of the rasteriser yields exactly the same edge slopes as the division, cf. render/slopelut.h
+// #define RESIDENCY_OFF // Leaves the meshes of all scenes in ROM (to measure what copying them into RAM saves), cf. residency.h
+// #define MATH_RECIPROCAL_CHECK // Checks on startup that fxReciprocal/fxmulReciprocal (perspective divide) match fxdiv, cf. math.h
 
 extern int g_mode;
+extern int g_canvasWidth, g_canvasHeight; // The size of the canvas our 3d pipeline draws into (160x100 in mode 5 unless changed by drawSetResolution, 240x160 in mode 4), set by videoM5ScaledInit/videoM4Init.
 extern Timer g_timer;
 extern int g_frameCount;
 
@@ -0,0 +1,101 @@
+#include <tonc.h>
+
+#include "governor.h"
+#include "logutils.h"
+#include "render/draw.h"
+
+static const QualityLevel *qualityLevels = NULL; // NULL if the governor is stopped.
+static int numQualityLevels, currentLevel;
+static FIXED_12 frameBudget;
+
+static FIXED_12 frameTimes[GOVERNOR_WINDOW]; // Ring buffer of the frame times drawn at the current level.
+static FIXED_12 frameTimeSum, frameTimeAvg;
+static int frameTimeCount; // The number of frames drawn at the current level. 
+
+/* 
+    How many frames we stay at a level before we try to go up again. If a level we went up to turns out to be over budget after all, this doubles,
+    so we don't bounce between a level which is just too expensive and the one below it. 
+*/
+static int upgradeHoldoff;
+static bool lastChangeWasUpgrade;
+
+static void governorApplyLevel(int level)
+{
+    lastChangeWasUpgrade = level < currentLevel;
+    currentLevel = level;
+    drawSetShadingDowngrade(qualityLevels[level].shadingDowngrade);
+    drawSetPointStride(qualityLevels[level].pointStride);
+    // The window starts over, so the next decision is based on frames drawn at the new level only.
+    frameTimeSum = 0;
+    frameTimeCount = 0;
+}
+
+void governorStart(int targetFps, const QualityLevel *levels, int numLevels)
+{
+    assertion(targetFps > 0, "governor.c: governorStart: targetFps > 0");
+    assertion(levels != NULL && numLevels > 0, "governor.c: governorStart: at least one quality level");
+    qualityLevels = levels;
+    numQualityLevels = numLevels;
+    frameBudget = int2fx12(1) / targetFps;
+    frameTimeAvg = 0;
+    upgradeHoldoff = GOVERNOR_WINDOW;
+    currentLevel = 0;
+    governorApplyLevel(0);
+}
+
+void governorStop(void)
+{
+    if (qualityLevels == NULL) {
+        return;
+    }
+    qualityLevels = NULL;
+    drawSetShadingDowngrade(0);
+    drawSetPointStride(1);
+}
+
+/* Has to be called once per frame with the duration of the last frame. */
+void governorUpdate(FIXED_12 frameTime)
+{
+    if (qualityLevels == NULL) {
+        return;
+    }
+    const int slot = frameTimeCount % GOVERNOR_WINDOW;
+    if (frameTimeCount >= GOVERNOR_WINDOW) {
+        frameTimeSum -= frameTimes[slot];
+    }
+    frameTimes[slot] = frameTime;
+    frameTimeSum += frameTime;
+    frameTimeCount++;
+    if (frameTimeCount < GOVERNOR_WINDOW) {
+        return;
+    }
+    frameTimeAvg = frameTimeSum / GOVERNOR_WINDOW;
+
+    if (frameTimeAvg > frameBudget && currentLevel < numQualityLevels - 1) {
+        // If we've just come up to this level, it's too expensive after all: Wait longer before we try again. Otherwise, the scene just got heavier.
+        upgradeHoldoff = lastChangeWasUpgrade ? MIN(upgradeHoldoff * 2, GOVERNOR_MAX_HOLDOFF) : GOVERNOR_WINDOW;
+        governorApplyLevel(currentLevel + 1);
+    } else if (frameTimeAvg * 100 < frameBudget * GOVERNOR_UPGRADE_PERCENT && currentLevel > 0 && frameTimeCount >= upgradeHoldoff) {
+        governorApplyLevel(currentLevel - 1);
+    }
+}
+
+int governorLevel(void)
+{
+    return currentLevel;
+}
+
+/* The settings of the current level (the ones of level 0 while the window is still filling up after governorStart). */
+const QualityLevel *governorSettings(void)
+{
+    assertion(qualityLevels != NULL, "governor.c: governorSettings: governor started");
+    return qualityLevels + currentLevel;
+}
+
+void governorPrint(void)
+{
+    if (qualityLevels == NULL) {
+        return;
+    }
+    mgba_printf("Quality level: %d/%d (frame time %f ms, budget %f ms)", currentLevel, numQualityLevels - 1, fx12ToFloat(frameTimeAvg * 1000), fx12ToFloat(frameBudget * 1000));
+}
@@ -0,0 +1,34 @@
+#ifndef GOVERNOR_H
+#define GOVERNOR_H
+
+#include "math.h"
+
+/*
+    Adaptive quality governor: It watches the frame time (averaged over the last GOVERNOR_WINDOW frames) against the budget of a target frame rate (e.g. 30 or 20 FPS),
+    and steps through the quality levels of the current scene: Down (cheaper) as long as the average is over budget, up again once it's well below it.
+    Level 0 is the full quality; each scene defines its own levels (e.g. as a const table), as only the scene knows which of its knobs are cheap to turn.
+    To avoid oscillating between two levels, we only go up if the average is below GOVERNOR_UPGRADE_PERCENT of the budget (hysteresis),
+    and never change the level until the window has been filled with frames drawn at the current level. 
+    If a level turns out to be over budget again right after we went up to it, we wait twice as long (up to GOVERNOR_MAX_HOLDOFF frames) before the next try.
+    Scenes call governorStart in their start and resume functions (after videoM5ScaledInit/videoM4Init), sceneSwitchTo stops it.
+*/
+#define GOVERNOR_WINDOW 16
+#define GOVERNOR_UPGRADE_PERCENT 75
+#define GOVERNOR_MAX_HOLDOFF (GOVERNOR_WINDOW * 16)
+
+typedef struct QualityLevel {
+    int shadingDowngrade; // Steps down the shading ladder, lit -> flat -> wireframe (cf. drawSetShadingDowngrade).
+    int pointStride; // drawPoints only draws every pointStride-th point (cf. drawSetPointStride).
+    int far; // The distance of the far plane of the scene's camera (integer, so the levels can be constant tables).
+    int decorativeInstances; // How many of the scene's decorative instances (the ones it can do without) are drawn.
+} QualityLevel;
+
+/* The levels are applied to the draw settings by the governor; far and decorativeInstances are up to the scene (cf. governorSettings). */
+void governorStart(int targetFps, const QualityLevel *levels, int numLevels);
+void governorStop(void);
+void governorUpdate(FIXED_12 frameTime);
+int governorLevel(void);
+const QualityLevel *governorSettings(void);
+void governorPrint(void);
+
+#endif
@@ -8,6 +8,8 @@
 #include "render/draw.h"
 #include "globals.h"
 #include "timer.h"
+#include "governor.h"
+#include "residency.h"
 
 // mgba_printf and the associated defines and enums by Nick Sells/adverseengineer: https://github.com/adverseengineer/libtonc/blob/master/include/tonc_mgba.h (last retrieved 2021-07-09)
 // (Modified by myself to always use LOG_INFO for ease of use)
@@ -51,8 +53,8 @@ void panic(const char* message)
     else
         mgba_printf("Unnamed error");
  
-    int w = g_mode == DCNT_MODE5 ? M5_SCALED_W : SCREEN_WIDTH;
-    int h = g_mode == DCNT_MODE5 ? M5_SCALED_H : SCREEN_HEIGHT;
+    int w = g_mode == DCNT_MODE5 ? g_canvasWidth : SCREEN_WIDTH;
+    int h = g_mode == DCNT_MODE5 ? g_canvasHeight : SCREEN_HEIGHT;
     char msg[256] = "Sorry ;w;";
 
     COLOR frontPal[3] = {CLR_YELLOW, CLR_RED, CLR_WHITE};
@@ -116,6 +118,9 @@ void perfPrint(void) {
     timerTick(&showPerfTimer);
     if (showPerfTimer.done || !g_frameCount) { 
         performancePrintAll();
+        drawPrintCullingStats();
+        governorPrint();
+        residencyPrint();
         timerStart(&showPerfTimer);
     }     
 
@@ -6,8 +6,11 @@
 #include "math.h"
 #include "timer.h"
 #include "scene.h"
+#include "governor.h"
 #include "model.h"
 #include "render/draw.h"
+#include "render/spanfill.h"
+#include "render/slopelut.h"
 
 #include "../data-audio/AAS_Data.h"
 
@@ -30,6 +33,18 @@ int main(void)
     globalsInit();
     drawInit();
     mathInit();
+#ifdef MATH_RECIPROCAL_CHECK
+    mathReciprocalCheck();
+#endif
+#ifdef SLOPE_LUT_CHECK
+    slopeLutCheck();
+#endif
+#ifdef SPANFILL_BENCHMARK
+    spanFillBenchmark();
+#endif
+#ifdef TRANSFORM_BENCHMARK
+    vecTransformBenchmark();
+#endif
     timerInit();
     modelInit();
     scenesInit();
@@ -45,6 +60,7 @@ int main(void)
         perfPrint();
         
         timerTick(&g_timer);
+        governorUpdate(g_timer.deltatime);
         ++g_frameCount;
     }
     return 0; // For dust thou art, and unto dust shalt thou return.
@@ -5,8 +5,7 @@
 #include "math.h"
 #include "logutils.h"
 #include "timer.h"
-
-// #define MATH_FAST_DIVISION (TODO: We don't use a LUT for divisions for now (which is not ideal); I ran into issues since the range of divisors was quite limited with the LUT, so I'll figure it out later)
+#include "globals.h"
 
 /*
     NOTE: The matrices and vectors are assumed to be in "column major order" conceptually throughout our whole codebase. 
@@ -16,11 +15,136 @@
 
 static int perfID;
 
+u16 reciprocalLUT[RECIPROCAL_LUT_SIZE]; // 1/d in .16 for d in [1, 2) (at the centre of each interval). In IWRAM (.bss), cf. fxReciprocal.
+
 void mathInit(void) 
 {
     perfID = performanceDataRegister("math: func");
+    for (int i = 0; i < RECIPROCAL_LUT_SIZE; ++i) {
+        // 2^16 / (1 + (i + 0.5) / RECIPROCAL_LUT_SIZE), rounded.
+        const u32 denom = 2 * RECIPROCAL_LUT_SIZE + 2 * i + 1;
+        reciprocalLUT[i] = ((1 << (16 + RECIPROCAL_LUT_BITS + 1)) + denom / 2) / denom;
+    }
 }
 
+#ifdef MATH_RECIPROCAL_CHECK
+/* 
+    Compares fxmulReciprocal with fxdiv for every denominator up to 1024.0 (i.e. beyond the far plane of all of our cameras) and quotients in [-1, 1] 
+    (which is the range of the perspective divide inside the view frustum), and panics if they differ by more than one LSB. 
+    Takes a while on hardware, which is why it's only compiled in on demand (cf. globals.h). 
+*/
+void mathReciprocalCheck(void) 
+{
+    for (FIXED denom = -int2fx(1024); denom <= int2fx(1024); ++denom) {
+        if (denom == 0) {
+            continue;
+        }
+        const FxReciprocal recip = fxReciprocal(denom);
+        const FIXED nums[] = {0, 1, -1, denom, -denom, denom - 1, denom / 3, -denom / 7};
+        for (int i = 0; i < (int)(sizeof(nums) / sizeof(nums[0])); ++i) {
+            const FIXED expected = fxdiv(nums[i], denom);
+            const FIXED actual = fxmulReciprocal(nums[i], recip);
+            if (ABS(expected - actual) > 1) {
+                mgba_printf("mathReciprocalCheck: %d / %d: fxdiv %d, reciprocal %d", nums[i], denom, expected, actual);
+                panic("mathReciprocalCheck: mismatch");
+            }
+        }
+    }
+    mgba_printf("mathReciprocalCheck: OK");
+}
+#endif
+
+#ifdef TRANSFORM_BENCHMARK
+
+#define TRANSFORM_BENCHMARK_VERTS 64 // Few enough that the slowest transform doesn't overflow the 16-bit cycle counter.
+#define TRANSFORM_BENCHMARK_NEAR int2fx(1)
+#define TRANSFORM_BENCHMARK_FAR int2fx(24) // Some of the vertices are beyond it, some are not.
+
+// In EWRAM like the buffers of draw.c (the vertices of our models are in ROM, which is about as slow with our waitstates).
+EWRAM_DATA static Vec3 benchmarkIn[TRANSFORM_BENCHMARK_VERTS], benchmarkOut[TRANSFORM_BENCHMARK_VERTS], benchmarkExpected[TRANSFORM_BENCHMARK_VERTS];
+EWRAM_DATA static PackedVec3 benchmarkPackedIn[TRANSFORM_BENCHMARK_VERTS]; // The same vertices as benchmarkIn.
+EWRAM_DATA static u8 benchmarkOutcodes[TRANSFORM_BENCHMARK_VERTS], benchmarkExpectedOutcodes[TRANSFORM_BENCHMARK_VERTS];
+static Matrix3x4 benchmarkMatrix;
+static FIXED benchmarkMatrix4x4[16];
+
+static void transformBatch(int count) 
+{
+    vecTransformBatch3x4(&benchmarkMatrix, benchmarkIn, benchmarkOut, benchmarkOutcodes, count, 1, TRANSFORM_BENCHMARK_NEAR, TRANSFORM_BENCHMARK_FAR);
+}
+
+static void transformPackedBatch(int count) 
+{
+    vecTransformPackedBatch3x4(&benchmarkMatrix, benchmarkPackedIn, benchmarkOut, benchmarkOutcodes, count, 1, TRANSFORM_BENCHMARK_NEAR, TRANSFORM_BENCHMARK_FAR);
+}
+
+static void transformEach3x4(int count) 
+{
+    for (int i = 0; i < count; ++i) {
+        benchmarkOut[i] = vecTransformed3x4(&benchmarkMatrix, benchmarkIn[i]);
+        benchmarkOutcodes[i] = vertexOutcode(benchmarkOut[i], TRANSFORM_BENCHMARK_NEAR, TRANSFORM_BENCHMARK_FAR);
+    }
+}
+
+static void transformEach4x4(int count) 
+{
+    for (int i = 0; i < count; ++i) {
+        benchmarkOut[i] = vecTransformed(benchmarkMatrix4x4, benchmarkIn[i]);
+        benchmarkOutcodes[i] = vertexOutcode(benchmarkOut[i], TRANSFORM_BENCHMARK_NEAR, TRANSFORM_BENCHMARK_FAR);
+    }
+}
+
+static int transformCycles(void (*transform)(int count), int count) 
+{
+    REG_TM2CNT = 0;
+    REG_TM2D = 0;
+    REG_TM2CNT = TM_ENABLE | TM_FREQ_1;
+    const u16 start = REG_TM2D;
+    transform(count);
+    const u16 end = REG_TM2D;
+    REG_TM2CNT = 0;
+    return (u16)(end - start);
+}
+
+/* Also checks that vecTransformBatch3x4 and vecTransformPackedBatch3x4 yield exactly the same vertices and outcodes as vecTransformed3x4 (draw.c mixes them). */
+void vecTransformBenchmark(void) 
+{
+    FIXED view[16], rotation[16];
+    matrix4x4setIdentity(view);
+    matrix4x4SetTranslation(view, (Vec3){.x=int2fx(1), .y=-int2fx(2), .z=-int2fx(20)});
+    matrix4x4createYawPitchRoll(rotation, deg2fxangle(30), deg2fxangle(-60), deg2fxangle(10));
+    matrix3x4createTransform(&benchmarkMatrix, view, rotation, (Vec3){.x=int2fx(2), .y=int2fx(1), .z=int2fx(1) / 2}, (Vec3){.x=0, .y=int2fx(1), .z=0});
+    matrix4x4createMul(view, rotation, benchmarkMatrix4x4);
+    for (int i = 0; i < TRANSFORM_BENCHMARK_VERTS; ++i) {
+        benchmarkIn[i] = (Vec3){.x=qran_range(-int2fx(4), int2fx(4)), .y=qran_range(-int2fx(4), int2fx(4)), .z=qran_range(-int2fx(4), int2fx(4))};
+        benchmarkPackedIn[i] = (PackedVec3){.x=benchmarkIn[i].x, .y=benchmarkIn[i].y, .z=benchmarkIn[i].z};
+    }
+
+    transformEach3x4(TRANSFORM_BENCHMARK_VERTS);
+    memcpy(benchmarkExpected, benchmarkOut, sizeof(benchmarkExpected));
+    memcpy(benchmarkExpectedOutcodes, benchmarkOutcodes, sizeof(benchmarkExpectedOutcodes));
+    transformBatch(TRANSFORM_BENCHMARK_VERTS);
+    if (memcmp(benchmarkExpected, benchmarkOut, sizeof(benchmarkExpected)) || memcmp(benchmarkExpectedOutcodes, benchmarkOutcodes, sizeof(benchmarkExpectedOutcodes))) {
+        panic("vecTransformBenchmark: vecTransformBatch3x4 differs from vecTransformed3x4");
+    }
+    transformPackedBatch(TRANSFORM_BENCHMARK_VERTS);
+    if (memcmp(benchmarkExpected, benchmarkOut, sizeof(benchmarkExpected)) || memcmp(benchmarkExpectedOutcodes, benchmarkOutcodes, sizeof(benchmarkExpectedOutcodes))) {
+        panic("vecTransformBenchmark: vecTransformPackedBatch3x4 differs from vecTransformed3x4");
+    }
+
+    const u16 ime = REG_IME;
+    REG_IME = 0; // No interrupts (audio) while measuring.
+    // The cycles per vertex, without the call overhead (the difference between a batch of all vertices and a batch of one).
+    const int batch = (transformCycles(transformBatch, TRANSFORM_BENCHMARK_VERTS) - transformCycles(transformBatch, 1)) / (TRANSFORM_BENCHMARK_VERTS - 1);
+    const int packedBatch = (transformCycles(transformPackedBatch, TRANSFORM_BENCHMARK_VERTS) - transformCycles(transformPackedBatch, 1)) / (TRANSFORM_BENCHMARK_VERTS - 1);
+    const int each3x4 = (transformCycles(transformEach3x4, TRANSFORM_BENCHMARK_VERTS) - transformCycles(transformEach3x4, 1)) / (TRANSFORM_BENCHMARK_VERTS - 1);
+    const int each4x4 = (transformCycles(transformEach4x4, TRANSFORM_BENCHMARK_VERTS) - transformCycles(transformEach4x4, 1)) / (TRANSFORM_BENCHMARK_VERTS - 1);
+    mgba_printf("transform: %d cycles per vertex (vecTransformBatch3x4), %d (vecTransformPackedBatch3x4), %d (vecTransformed3x4), %d (vecTransformed, 4x4)", batch, packedBatch, each3x4, each4x4);
+    mgba_printf("transform: %d cycles per batch of one vertex (vecTransformBatch3x4)", transformCycles(transformBatch, 1));
+    REG_IME = ime;
+}
+
+#endif
+
 
 Vec3 vecTransformed(const FIXED matrix[16], Vec3 vec) 
 {
@@ -32,15 +156,10 @@ Vec3 vecTransformed(const FIXED matrix[16], Vec3 vec)
     
     if (w != int2fx(1)) { // If it's not an affine transform (e.g. perspective projection), we have to explicitly convert homogenous coordinates back to cartesian. 
         assertion(w != 0,  "w != 0");
-        #ifdef MATH_FAST_DIVISION
-        transformed.x = fxDivFast(transformed.x, w);
-        transformed.y = fxDivFast(transformed.y, w);
-        transformed.z = fxDivFast(transformed.z, w); 
-        #else
-        transformed.x = fxdiv(transformed.x, w);
-        transformed.y = fxdiv(transformed.y, w);
-        transformed.z = fxdiv(transformed.z, w); 
-        #endif
+        const FxReciprocal invW = fxReciprocal(w);
+        transformed.x = fxmulReciprocal(transformed.x, invW);
+        transformed.y = fxmulReciprocal(transformed.y, invW);
+        transformed.z = fxmulReciprocal(transformed.z, invW); 
     }
     return transformed;
 }
@@ -55,15 +174,10 @@ void vecTransform(const FIXED matrix[16], Vec3 *vec)
     *vec = transformed;
     if (w != int2fx(1)) { // If it's not an affine transform (e.g. perspective projection), we have to explicitly convert homogenous coordinates back to cartesian. 
         assertion(w != 0,  "w != 0");
-        #ifdef MATH_FAST_DIVISION
-        vec->x = fxDivFast(transformed.x, w);
-        vec->y = fxDivFast(transformed.y, w);
-        vec->z = fxDivFast(transformed.z, w); 
-        #else
-        vec->x = fxdiv(transformed.x, w);
-        vec->y = fxdiv(transformed.y, w);
-        vec->z = fxdiv(transformed.z, w); 
-        #endif
+        const FxReciprocal invW = fxReciprocal(w);
+        vec->x = fxmulReciprocal(transformed.x, invW);
+        vec->y = fxmulReciprocal(transformed.y, invW);
+        vec->z = fxmulReciprocal(transformed.z, invW); 
     }
 }
 
@@ -86,6 +200,16 @@ Vec3 vecTransformedRot(FIXED rotmat[16], const Vec3 *v)
     return rotated;
 }
 
+/* The transposed (i.e. inverse) rotation, e.g. to get world space directions into the model space of an instance. */
+Vec3 vecTransformedRotInverse(const FIXED rotmat[16], Vec3 v) 
+{
+    Vec3 rotated;
+    rotated.x = fxmul(v.x, rotmat[0]) + fxmul(v.y, rotmat[4]) + fxmul(v.z, rotmat[8] );
+    rotated.y = fxmul(v.x, rotmat[1]) + fxmul(v.y, rotmat[5]) + fxmul(v.z, rotmat[9] );
+    rotated.z = fxmul(v.x, rotmat[2]) + fxmul(v.y, rotmat[6]) + fxmul(v.z, rotmat[10]);
+    return rotated;
+}
+
 Vec3 vecScaled(Vec3 vec, FIXED factor) 
 {
     vec.x = fxmul(vec.x, factor);
@@ -296,6 +420,37 @@ void matrix4x4createMul(const FIXED a[16], const FIXED b[16], FIXED result[16])
     }
 }
 
+/* 
+    result = view * translation * rotmat * scale, where view and rotmat are affine (e.g. the world2cam matrix of a camera and the rotation of a model instance). 
+    The products of the .8 entries are .16 already, so the linear part isn't rounded at all until the scale is applied. 
+*/
+void matrix3x4createTransform(Matrix3x4 *result, const FIXED view[16], const FIXED rotmat[16], Vec3 scale, Vec3 translation) 
+{
+    const FIXED scales[3] = {scale.x, scale.y, scale.z};
+    for (int row = 0; row < 3; ++row) {
+        for (int col = 0; col < 3; ++col) {
+            s32 value = 0;
+            for (int i = 0; i < 3; ++i) {
+                value += matrix4x4Get(view, row, i) * matrix4x4Get(rotmat, i, col);
+            }
+            result->linear[row * 3 + col] = (s32)(((s64)value * scales[col]) >> FIX_SHIFT);
+        }
+    }
+    vecTranformAffine(view, &translation);
+    result->translation = translation;
+}
+
+/* The same transform as the (affine) 4x4 matrix, e.g. the world2cam matrix of a camera. */
+void matrix3x4createAffine(Matrix3x4 *result, const FIXED matrix[16]) 
+{
+    for (int row = 0; row < 3; ++row) {
+        for (int col = 0; col < 3; ++col) {
+            result->linear[row * 3 + col] = matrix4x4Get(matrix, row, col) << FIX_SHIFT;
+        }
+    }
+    result->translation = matrix4x4GetTranslation(matrix);
+}
+
 void matrix4x4Transpose(FIXED mat[16]) 
 { // Useful, as the inversion of a square orthonormal matrix is equivalent to its transposition. We don't really need to invert other matrices so far. 
     FIXED tmp[16];
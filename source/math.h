@@ -15,6 +15,21 @@ typedef struct Vec3 {
      FIXED x, y, z;
 } ALIGN4 Vec3; 
 
+/* A vector in 16 bits per component, e.g. the vertices of our models in ROM (cf. Model.vertShift), which are unpacked as they're transformed (cf. vecTransformPackedBatch3x4). */
+typedef struct PackedVec3 {
+    s16 x, y, z;
+} PackedVec3;
+
+/*
+    An affine transform which we apply to lots of vertices, e.g. model space to camera space (cf. matrix3x4createTransform): 
+    The 3x3 linear part (rotation and scale) is .16 fixed point, so concatenating .8 matrices doesn't throw away any precision (and small scale factors survive), 
+    the translation is .8 like our vectors. Transforming a vector costs 9 multiplications (cf. vecTransformed3x4). 
+*/
+typedef struct Matrix3x4 {
+    s32 linear[9]; // Row-major.
+    Vec3 translation;
+} Matrix3x4;
+
 typedef s32 FIXED_12;
 typedef FIXED_12 ANGLE_FIXED_12;
 
@@ -33,6 +48,7 @@ IWRAM_CODE_ARM Vec3 vecTransformed(const FIXED matrix[16], Vec3 vec);
 IWRAM_CODE_ARM void vecTransform(const FIXED matrix[16], Vec3 *vec);
 IWRAM_CODE_ARM void vecTranformAffine(const FIXED matrix[16], Vec3 *vec);
 IWRAM_CODE_ARM Vec3 vecTransformedRot(FIXED rotmat[16], const Vec3 *v);
+IWRAM_CODE_ARM Vec3 vecTransformedRotInverse(const FIXED rotmat[16], Vec3 v);
 
 IWRAM_CODE_ARM void matrix4x4setIdentity(FIXED matrix[16]);
 IWRAM_CODE_ARM void matrix4x4SetTranslation(FIXED matrix[16], Vec3 translation);
@@ -51,9 +67,28 @@ IWRAM_CODE_ARM void matrix4x4createRotZ(FIXED matrix[16], ANGLE_FIXED_12 angle);
 IWRAM_CODE_ARM void matrix4x4Mul(FIXED a[16], const FIXED b[16]);
 IWRAM_CODE_ARM void matrix4x4createMul(const FIXED a[16], const FIXED b[16], FIXED result[16]);
 
+IWRAM_CODE_ARM void matrix3x4createTransform(Matrix3x4 *result, const FIXED view[16], const FIXED rotmat[16], Vec3 scale, Vec3 translation);
+IWRAM_CODE_ARM void matrix3x4createAffine(Matrix3x4 *result, const FIXED matrix[16]);
+
+#define VERTEX_OUTCODE_NEAR 1 // Behind the near plane (z > -near, our cameras look down -z).
+#define VERTEX_OUTCODE_FAR 2 // Beyond the far plane (z < -far).
+/* 
+    Transforms count vertices (every stride-th one of in) like vecTransformed3x4 does, and writes their near/far outcodes in the same pass.
+    In asm/transform3x4.s (ARM, in IWRAM), so the call and the setup of the matrix are paid once per batch instead of once per vertex. 
+*/
+void vecTransformBatch3x4(const Matrix3x4 *m, const Vec3 *in, Vec3 *out, u8 *outcodes, int count, int stride, FIXED near, FIXED far);
+void vecTransformPackedBatch3x4(const Matrix3x4 *m, const PackedVec3 *in, Vec3 *out, u8 *outcodes, int count, int stride, FIXED near, FIXED far); // The same for 16-bit input.
+
 IWRAM_CODE_ARM FIXED lerpSmooth(FIXED start, FIXED end, FIXED_12 t);
 
 void mathInit(void);
+#ifdef MATH_RECIPROCAL_CHECK
+void mathReciprocalCheck(void);
+#endif
+#ifdef TRANSFORM_BENCHMARK
+/* Prints the cycles per vertex of vecTransformBatch3x4, vecTransformed3x4 and vecTransformed with mgba_printf. Has to be called before timerInit (it uses timer 2). */
+void vecTransformBenchmark(void);
+#endif
 
 INLINE FIXED_12 int2fx12(int num) {
     return (ANGLE_FIXED_12) num << 12;
@@ -95,20 +130,85 @@ INLINE FIXED sinFx(FIXED_12 alpha) {
 }
 
 
-// INLINE FIXED fxDivFast(FIXED num, FIXED denom) { // IMPORTANT: has limited range, up to RECIPROCAL_MAX_RANGE; should only be used for perspective divide
-//     panic("fxdivfast is deprecated");
-//     assertion(denom != 0, "lutfxDiv: denom != 0");
-//     assertion(fx2int(denom) < RECIPROCAL_MAX_INT, "fxDivFast: lut out of range");
-//     FIXED invDenom = reciprocalLUT[(ABS(denom) - 1) & (RECIPROCAL_LUT_SIZE - 1)]; // abs instead of uint
-//     FIXED u_result = (num * invDenom) >> (RECIPROCAL_FRACT_SHIFT) >> (RECIPROCAL_FRACT_SHIFT - FIX_SHIFT);
-//     return denom < 0 ? -u_result: u_result; // don't assume denom is positive
-// }
+/*
+    Reciprocals for the perspective divide (and other divisions where the same denominator is used more than once): 
+    Instead of calling fxdiv for x and y (and z), we calculate 1/denom once, and multiply by it. 
+    denom is normalised to [1, 2) (the ARM7TDMI doesn't have a CLZ instruction, so we count the leading zeros with a few conditional shifts), 
+    the first 8 bits after the leading one are used to look up an estimate of 1/denom (~9 bits of precision, cf. reciprocalLUT), 
+    and one Newton-Raphson step (y' = y * (2 - d * y)) roughly doubles the precision to ~17 bits. 
+    This works for any denominator (i.e. any near and far plane); the relative error of the reciprocal is below 2^-17, so for quotients in [-1, 1] 
+    (e.g. the perspective divide of vertices inside the view frustum), the result is within one LSB of fxdiv's (it rounds towards negative infinity instead of zero).
+*/
+#define MATH_FAST_DIVISION // Comment out to use fxdiv for the perspective divides again. 
+
+#define RECIPROCAL_LUT_BITS 8
+#define RECIPROCAL_LUT_SIZE (1 << RECIPROCAL_LUT_BITS)
+extern u16 reciprocalLUT[RECIPROCAL_LUT_SIZE];
+
+typedef struct FxReciprocal { 
+    #ifdef MATH_FAST_DIVISION
+    s32 mantissa; // 1/denom = mantissa * 2^-(shift + FIX_SHIFT)
+    int shift;
+    #else
+    FIXED denom;
+    #endif
+} FxReciprocal;
+
+INLINE FxReciprocal fxReciprocal(FIXED denom) // denom must not be 0.
+{
+    #ifdef MATH_FAST_DIVISION
+    u32 d = ABS(denom);
+    int lz = 0;
+    if (d <= 0xFFFF) { d <<= 16; lz += 16; }
+    if (d <= 0xFFFFFF) { d <<= 8; lz += 8; }
+    if (d <= 0xFFFFFFF) { d <<= 4; lz += 4; }
+    if (d <= 0x3FFFFFFF) { d <<= 2; lz += 2; }
+    if (d <= 0x7FFFFFFF) { d <<= 1; lz += 1; }
+    // d is in [1, 2) in .31 now; y is 1/d in .31.
+    const u32 y0 = (u32)reciprocalLUT[(d >> (31 - RECIPROCAL_LUT_BITS)) & (RECIPROCAL_LUT_SIZE - 1)] << 15;
+    const u32 e = (u32)(((u64)d * y0) >> 31); // d * y0, close to 1.
+    u32 y1 = (u32)(((u64)y0 * (0u - e)) >> 31); // (0u - e) is 2 - d * y0 in .31 (modulo 2^32).
+    if (y1 > 0x7FFFFFFF) { // Only for d == 1.0.
+        y1 = 0x7FFFFFFF;
+    }
+    // 1/|denom| = y1 * 2^(lz - 62).
+    return (FxReciprocal){.mantissa = denom < 0 ? -(s32)y1 : (s32)y1, .shift = 62 - FIX_SHIFT - lz};
+    #else
+    return (FxReciprocal){.denom = denom};
+    #endif
+}
+
+INLINE FIXED fxmulReciprocal(FIXED num, FxReciprocal recip) // Equivalent to fxdiv(num, denom) where recip = fxReciprocal(denom). 
+{
+    #ifdef MATH_FAST_DIVISION
+    return (FIXED)(((s64)num * recip.mantissa) >> recip.shift);
+    #else
+    return fxdiv(num, recip.denom);
+    #endif
+}
 
 INLINE FIXED_12 freq(FIXED_12 hz) {
     return fx12mul(hz, TAU);
 }
 
 
+/* The three rows are summed up in 64 bits (SMULL/SMLAL) before they're shifted back to .8. */
+INLINE Vec3 vecTransformed3x4(const Matrix3x4 *m, Vec3 v)
+{
+    const s32 *l = m->linear;
+    Vec3 result;
+    result.x = (FIXED)(((s64)l[0] * v.x + (s64)l[1] * v.y + (s64)l[2] * v.z) >> 16) + m->translation.x;
+    result.y = (FIXED)(((s64)l[3] * v.x + (s64)l[4] * v.y + (s64)l[5] * v.z) >> 16) + m->translation.y;
+    result.z = (FIXED)(((s64)l[6] * v.x + (s64)l[7] * v.y + (s64)l[8] * v.z) >> 16) + m->translation.z;
+    return result;
+}
+
+/* The near/far outcode of a vertex in camera space (cf. vecTransformBatch3x4). */
+INLINE u8 vertexOutcode(Vec3 v, FIXED near, FIXED far)
+{
+    return (v.z > -near ? VERTEX_OUTCODE_NEAR : 0) | (v.z < -far ? VERTEX_OUTCODE_FAR : 0);
+}
+
 INLINE FIXED_12 deg2fxangle(int angle_degrees) {
     return (ONE_DEGREE * (angle_degrees));
 }
@@ -10,8 +10,13 @@
 #include "render/draw.h"
 #include "globals.h"
 
-static Vec3 cubeModelVerts[8];
-static Face cubeModelFaces[12];
+static PackedVec3 cubeModelVerts[8];
+static Face cubeModelFaces[6];
+static u32 cubeModelFaceIndices[6];
+static TexCoord cubeModelTexCoords[6 * FACE_MAX_VERTS];
+#define CUBE_TEXTURE_SIZE_LOG2 5
+EWRAM_DATA static COLOR cubeTexels[1 << (CUBE_TEXTURE_SIZE_LOG2 * 2)];
+static Texture cubeTexture;
 Model cubeModel;
 
 void modelInstancePoolReset(ModelInstancePool *pool) 
@@ -52,6 +57,9 @@ ModelInstance* modelInstanceAdd(ModelInstancePool *pool,  Model model, const Vec
     new->state.scale.x = scale->x; new->state.scale.y = scale->y; new->state.scale.z = scale->z;
     new->state.shading = shading;
     new->state.backfaceCulling = true;
+    new->state.hidden = false;
+    new->state.transformDirty = true;
+    new->state.cache = NULL;
 
     pool->instanceCount++;
     return new;
@@ -79,18 +87,74 @@ int modelInstanceRemove(ModelInstancePool *pool, ModelInstance* instance)
 }
 
 
-Model modelNew(const Vec3 *verts, const Face *faces, int numVerts, int numFaces) 
+Model modelNew(const PackedVec3 *verts, int vertShift, const Face *faces, const u32 *faceIndices, int numVerts, int numFaces) 
 {
     assertion(numVerts <= MAX_MODEL_VERTS, "model.c: modelNew: numVert <= MAX");
     assertion(numFaces <= MAX_MODEL_FACES, "model.c: modelNew: numFaces <= MAX");
-    Model m = {.faces=faces, .verts=verts, .numVerts=numVerts, .numFaces=numFaces};
+    assertion(vertShift >= 0 && vertShift < 16, "model.c: modelNew: 0 <= vertShift < 16");
+    Model m = {.faces=faces, .faceIndices=faceIndices, .verts=verts, .vertShift=vertShift, .numVerts=numVerts, .numFaces=numFaces, .texture=NULL, .texCoords=NULL, .vertNormals=NULL, .edges=NULL, .numEdges=0, .boundsCenter={0, 0, 0}, .boundsRadius=-1, .lod=NULL, .lodDistance=0, .meshlets=NULL, .numMeshlets=0};
     return m;
 }
 
+void modelSetTexture(Model *model, const Texture *texture, const TexCoord *texCoords) 
+{
+    assertion(texture != NULL && texCoords != NULL, "model.c: modelSetTexture: texture and texCoords not NULL");
+    assertion(texture->widthLog2 <= 8 && texture->heightLog2 <= 8, "model.c: modelSetTexture: texture at most 256x256");
+    model->texture = texture;
+    model->texCoords = texCoords;
+}
+
+void modelSetVertexNormals(Model *model, const PackedNormal *vertNormals) 
+{
+    assertion(vertNormals != NULL, "model.c: modelSetVertexNormals: vertNormals not NULL");
+    model->vertNormals = vertNormals;
+}
+
+void modelSetEdges(Model *model, const Edge *edges, int numEdges) 
+{
+    assertion(edges != NULL, "model.c: modelSetEdges: edges not NULL");
+    assertion(numEdges <= MAX_MODEL_EDGES, "model.c: modelSetEdges: numEdges <= MAX");
+    model->edges = edges;
+    model->numEdges = numEdges;
+}
+
+void modelSetBoundingSphere(Model *model, Vec3 center, FIXED radius) 
+{
+    assertion(radius >= 0, "model.c: modelSetBoundingSphere: radius >= 0");
+    model->boundsCenter = center;
+    model->boundsRadius = radius;
+}
+
+/* 
+    Discrete levels of detail: Beyond the distance (in model space units, i.e. it's scaled with the instance), lod is drawn instead of the model. 
+    The LODs form a chain (a LOD can have a coarser LOD of its own at a larger distance); obj2model.py sets them up for name_lod1.obj etc.
+*/
+void modelSetLod(Model *model, const Model *lod, FIXED distance) 
+{
+    assertion(lod != NULL && lod != model, "model.c: modelSetLod: lod not NULL and not the model itself");
+    assertion(distance > 0, "model.c: modelSetLod: distance > 0");
+    model->lod = lod;
+    model->lodDistance = distance;
+}
+
+/* The meshlets (cf. obj2model.py) have to cover the faces of the model in order, without gaps. */
+void modelSetMeshlets(Model *model, const Meshlet *meshlets, int numMeshlets) 
+{
+    assertion(meshlets != NULL && numMeshlets > 0, "model.c: modelSetMeshlets: meshlets not NULL");
+    int faces = 0;
+    for (int i = 0; i < numMeshlets; ++i) {
+        assertion(meshlets[i].firstFace == faces && meshlets[i].numFaces > 0, "model.c: modelSetMeshlets: meshlets cover the faces in order");
+        faces += meshlets[i].numFaces;
+    }
+    assertion(faces == model->numFaces, "model.c: modelSetMeshlets: meshlets cover all faces");
+    model->meshlets = meshlets;
+    model->numMeshlets = numMeshlets;
+}
+
 void modelInit(void) 
 {
-    FIXED half = int2fx(1) >> 2; // quarter?
-    Vec3 verts[8] = {
+    s16 half = int2fx(1) >> 2; // quarter?
+    PackedVec3 verts[8] = {
         // front plane
         {.x = -half, .y = -half, .z = half},
         {.x = -half, .y = half, .z = half},
@@ -103,26 +167,42 @@ void modelInit(void)
         {.x = half, .y = -half, .z = -half},
     };
     memcpy(cubeModelVerts, verts, sizeof(cubeModelVerts));
-    Face trigs[12] = { // Counter-clockwise winding order.
-        // front
-        {.vertexIndex = {0, 3, 2}, .color = CLR_CYAN, .normal={0, 0, int2fx(1)}, .type=TriangleFace}, 
-        {.vertexIndex = {2, 1, 0}, .color = CLR_CYAN, .normal={0, 0, int2fx(1)}, .type=TriangleFace},
-        // back
-        {.vertexIndex = {6, 7, 4}, .color = CLR_RED, .normal={0, 0, int2fx(-1)}, .type=TriangleFace},  
-        {.vertexIndex = {4, 5, 6}, .color = CLR_RED, .normal={0, 0, int2fx(-1)}, .type=TriangleFace},  
-        // right
-        {.vertexIndex = {3, 7, 6}, .color = CLR_BLUE, .normal={int2fx(1), 0, 0}, .type=TriangleFace},
-        {.vertexIndex = {6, 2, 3}, .color = CLR_BLUE, .normal={int2fx(1), 0, 0}, .type=TriangleFace},  
-        // left
-        {.vertexIndex = {1, 5, 4}, .color = CLR_MAG, .normal={int2fx(-1), 0, 0}, .type=TriangleFace},
-        {.vertexIndex = {4, 0, 1}, .color = CLR_MAG, .normal={int2fx(-1), 0, 0}, .type=TriangleFace},
-        // bottom
-        {.vertexIndex = {7, 3, 0}, .color = CLR_GREEN, .normal={0, int2fx(-1), 0}, .type=TriangleFace}, 
-        {.vertexIndex = {0, 4, 7}, .color = CLR_GREEN, .normal={0, int2fx(-1), 0}, .type=TriangleFace},
-        // top
-        {.vertexIndex = {6, 5, 1}, .color = CLR_YELLOW, .normal={0, int2fx(1), 0}, .type=TriangleFace},
-        {.vertexIndex = {1, 2, 6}, .color = CLR_YELLOW, .normal={0, int2fx(1), 0}, .type=TriangleFace},
+    Face quads[6] = { // Counter-clockwise winding order.
+        {.color = CLR_CYAN, .normal={0, 0, 127}, .type=ConvexPlanarQuadFace}, // front
+        {.color = CLR_RED, .normal={0, 0, -127}, .type=ConvexPlanarQuadFace}, // back
+        {.color = CLR_BLUE, .normal={127, 0, 0}, .type=ConvexPlanarQuadFace}, // right
+        {.color = CLR_MAG, .normal={-127, 0, 0}, .type=ConvexPlanarQuadFace}, // left
+        {.color = CLR_GREEN, .normal={0, -127, 0}, .type=ConvexPlanarQuadFace}, // bottom
+        {.color = CLR_YELLOW, .normal={0, 127, 0}, .type=ConvexPlanarQuadFace}, // top
     };
-    memcpy(cubeModelFaces, trigs, 12 * sizeof(Face));
-    cubeModel = modelNew(cubeModelVerts, cubeModelFaces, 8, 12);
+    const u8 quadIndices[6][4] = {{0, 3, 2, 1}, {6, 7, 4, 5}, {3, 7, 6, 2}, {1, 5, 4, 0}, {7, 3, 0, 4}, {6, 5, 1, 2}};
+    for (int i = 0; i < 6; ++i) {
+        const PackedVec3 v = verts[quadIndices[i][0]];
+        quads[i].planeDist = vecDot(unpackNormal(quads[i].normal), (Vec3){.x=v.x, .y=v.y, .z=v.z});
+        cubeModelFaceIndices[i] = quadIndices[i][0] | (quadIndices[i][1] << 8) | (quadIndices[i][2] << 16) | (quadIndices[i][3] << 24);
+    }
+    memcpy(cubeModelFaces, quads, 6 * sizeof(Face));
+    cubeModel = modelNew(cubeModelVerts, 0, cubeModelFaces, cubeModelFaceIndices, 8, 6);
+    modelSetBoundingSphere(&cubeModel, (Vec3){0, 0, 0}, fxmul(half, 444)); // sqrt(3) * half (rounded up).
+
+    // We map the whole texture onto each side of the cube. 
+    const TexCoord quadTexCoords[4] = {{.u=0, .v=int2fx(1)}, {.u=int2fx(1), .v=int2fx(1)}, {.u=int2fx(1), .v=0}, {.u=0, .v=0}};
+    for (int i = 0; i < 6; ++i) {
+        for (int j = 0; j < 4; ++j) {
+            cubeModelTexCoords[i * FACE_MAX_VERTS + j] = quadTexCoords[j];
+        }
+    }
+    // A checkerboard with a border, so we can see how the texture is mapped. 
+    const int size = 1 << CUBE_TEXTURE_SIZE_LOG2;
+    for (int y = 0; y < size; ++y) {
+        for (int x = 0; x < size; ++x) {
+            COLOR clr = ((x >> 3) + (y >> 3)) % 2 ? RGB15(31, 20, 5) : RGB15(16, 0, 15);
+            if (x == 0 || y == 0 || x == size - 1 || y == size - 1) {
+                clr = CLR_WHITE;
+            }
+            cubeTexels[y * size + x] = clr;
+        }
+    }
+    cubeTexture = (Texture){.texels=cubeTexels, .widthLog2=CUBE_TEXTURE_SIZE_LOG2, .heightLog2=CUBE_TEXTURE_SIZE_LOG2};
+    modelSetTexture(&cubeModel, &cubeTexture, cubeModelTexCoords);
 }
@@ -6,7 +6,8 @@
 #include "raster_geometry.h"
 
 #define MAX_MODEL_VERTS 512
-#define MAX_MODEL_FACES 512
+#define MAX_MODEL_FACES 2048 // Models with more than a few dozen faces are split into meshlets, so we only process the faces of the visible ones (cf. Meshlet).
+#define MAX_MODEL_EDGES 1024
 
 /*
     We want to use object pools to manage our modelInstances, just a thin abstraction on top of static arrays with no dynamic allocations etc. 
@@ -18,20 +19,71 @@
 
 typedef enum FaceType {
     TriangleFace, 
-    ConvexPlanarQuadFace
+    ConvexPlanarQuadFace // Culled, lit and sorted once, and rasterised as a single polygon (cf. rasterisePolygonFlat). 
 } FaceType;
 
+/* A unit vector in .7 fixed point, 8 bits per component (1.0 is clamped to 127), e.g. the normals of our models in ROM (cf. unpackNormal). */
+typedef struct PackedNormal {
+    s8 x, y, z;
+} PackedNormal;
+
+/*
+    Our models are read from ROM (through the 16-bit cartridge bus, with waitstates) every frame, so their data is packed: 12 bytes per face (instead of 40), 
+    6 bytes per vertex, 3 bytes per vertex normal (cf. obj2model.py). It's unpacked as it's read (cf. modelFaceVertexIndices, unpackNormal, vecTransformPackedBatch3x4).
+    The faces don't save the vertices explicity, but indices to them (as vertices are usually shared among different faces, we save memory), 
+    which are stored separately (cf. Model.faceIndices), as culled faces don't need them.
+*/
 typedef struct Face {
-    FaceType type;
-    int vertexIndex[4];  // The faces don't save the vertices explicity, but indices to them (as vertices are usually shared among different faces, we save memory.)
-    Vec3 normal;
+    FIXED planeDist; // vecDot(unpackNormal(normal), vertex) for the vertices of the face, i.e. the camera (in model space) sees the face iff that's > planeDist for the camera.
+    PackedNormal normal;
+    u8 type; // FaceType
     COLOR color;
 } Face;
 
+#define FACE_MAX_VERTS 4
+#define MODEL_MAX_NARROW_VERTS 256 // Models with up to that many vertices have 8-bit vertex indices, the others 16-bit ones.
+
+/* 
+    An edge of the wireframe of a model. Every edge is stored once, even if it is shared by several faces (cf. obj2model.py), 
+    so SHADING_WIREFRAME doesn't draw the interior edges twice like it would by outlining each face. 
+*/
+typedef struct Edge {
+    u16 vertexIndex[2];
+    COLOR color; // The colour of the (first) face the edge belongs to.
+} Edge;
+
+/* 
+    A cluster of (between MESHLET_MIN_FACES and MESHLET_MERGED_MAX_FACES in obj2model.py) neighbouring faces of a model with similar normals, a contiguous range of Model.faces. 
+    Before any of its faces are processed, a meshlet is culled as a whole if its bounding sphere is outside of the view frustum, 
+    or if the camera is behind all of its faces: The normals lie within a cone around coneAxis, and if the camera (in model space) sees the bounding sphere 
+    from within the "back" of that cone, none of the faces can face it (cf. meshletTest in render/draw.c). 
+    (cf. Arseny Kapoulkine's meshoptimizer, meshopt_computeMeshletBounds, whose cone test this is.)
+*/
+typedef struct Meshlet {
+    int firstFace, numFaces;
+    Vec3 center; // The bounding sphere of the vertices of its faces (in model space). 
+    FIXED radius; 
+    Vec3 coneAxis; // Unit length.
+    FIXED coneCutoff; // The sine of the opening angle of the normal cone (rounded up); int2fx(1) if it's too wide to ever cull the meshlet.
+} Meshlet;
+
 typedef struct Model {
-    const Vec3 *verts;
+    const PackedVec3 *verts; // .8 fixed point like Vec3, but shifted right by vertShift (so the vertices of large models fit into 16 bits).
+    int vertShift;
     const Face *faces;
+    const u32 *faceIndices; // The FACE_MAX_VERTS vertex indices of each face, 8 bits each (one word per face), or 16 bits each (two words) for models with more than MODEL_MAX_NARROW_VERTS vertices.
     int numVerts, numFaces;
+    const Texture *texture; // NULL for untextured models.
+    const TexCoord *texCoords; // FACE_MAX_VERTS per face (in the order of the vertex indices), NULL for untextured models.
+    const PackedNormal *vertNormals; // One (unit) normal per vertex for SHADING_GOURAUD, NULL if the model has none.
+    const Edge *edges; // The unique edges for SHADING_WIREFRAME, NULL if the model has none (then the outlines of the faces are drawn).
+    int numEdges;
+    Vec3 boundsCenter; // The bounding sphere of the vertices in model space for frustum culling (cf. obj2model.py); instances of models without one (negative radius) are never culled.
+    FIXED boundsRadius;
+    const struct Model *lod; // The next (coarser) level of detail, which is drawn instead if the instance is farther away than lodDistance (in model space units), NULL if there is none (cf. modelSetLod).
+    FIXED lodDistance;
+    const Meshlet *meshlets; // Covering all faces in order, NULL if the model isn't split into meshlets (then its faces are processed one by one).
+    int numMeshlets;
 } Model;
 
 
@@ -75,8 +127,15 @@ typedef struct ModelInstance { // Different Instances share their vertex/face da
             Vec3 scale;
             ANGLE_FIXED_12 yaw, pitch, roll;
             PolygonShadingType shading;
-            FIXED camSpaceDepth;
+            FIXED camSpaceDepth; // The depth of the centre of the bounding sphere (cf. modelInstancesPrepareDraw), which selects the level of detail.
             bool backfaceCulling;
+            bool hidden; // Hidden instances stay in their pool, but aren't drawn.
+            // Dirty tracking for the transform cache (cf. render/transformcache.h): The transform of the last frame, and whether the current one differs from it.
+            Vec3 lastPos, lastScale;
+            ANGLE_FIXED_12 lastYaw, lastPitch, lastRoll;
+            bool transformDirty;
+            struct TransformCacheEntry *cache; // Only valid if cacheGeneration is the current one of the cache.
+            int cacheGeneration;
         }; 
     } ALIGN4 state;
 
@@ -90,12 +149,42 @@ typedef struct ModelInstancePool {
 } ModelInstancePool;
 
 void modelInit(void);
-Model modelNew(const Vec3 *verts, const Face *faces, int numVerts, int numFaces);
+Model modelNew(const PackedVec3 *verts, int vertShift, const Face *faces, const u32 *faceIndices, int numVerts, int numFaces);
+void modelSetTexture(Model *model, const Texture *texture, const TexCoord *texCoords);
+void modelSetVertexNormals(Model *model, const PackedNormal *vertNormals);
+void modelSetEdges(Model *model, const Edge *edges, int numEdges);
+void modelSetBoundingSphere(Model *model, Vec3 center, FIXED radius);
+void modelSetLod(Model *model, const Model *lod, FIXED distance);
+void modelSetMeshlets(Model *model, const Meshlet *meshlets, int numMeshlets);
 ModelInstancePool modelInstancePoolNew(ModelInstance *buffer, int bufferCapacity);
 void modelInstancePoolReset(ModelInstancePool *pool);
 int modelInstanceRemove(ModelInstancePool *pool, ModelInstance* instance);
 ModelInstance* modelInstanceAdd(ModelInstancePool *pool,  Model model, const Vec3 *pos, const Vec3 *scale, ANGLE_FIXED_12 yaw, ANGLE_FIXED_12 pitch, ANGLE_FIXED_12 roll, PolygonShadingType shading);
 ModelInstance* modelInstanceAddVanilla(ModelInstancePool *pool,  Model model, const Vec3 *pos, FIXED scale, PolygonShadingType shading);
 
+/* Normals are unpacked to .8 fixed point (unit length being 254 instead of 256). */
+INLINE Vec3 unpackNormal(PackedNormal n)
+{
+    return (Vec3){.x=n.x * 2, .y=n.y * 2, .z=n.z * 2};
+}
+
+/* The vertex indices of face faceNum (FACE_MAX_VERTS of them, the last one is 0 for triangles). */
+INLINE void modelFaceVertexIndices(const Model *model, int faceNum, int vertexIndex[FACE_MAX_VERTS])
+{
+    if (model->numVerts <= MODEL_MAX_NARROW_VERTS) {
+        const u32 indices = model->faceIndices[faceNum];
+        vertexIndex[0] = indices & 0xFF;
+        vertexIndex[1] = (indices >> 8) & 0xFF;
+        vertexIndex[2] = (indices >> 16) & 0xFF;
+        vertexIndex[3] = indices >> 24;
+    } else {
+        const u32 *indices = model->faceIndices + faceNum * 2;
+        vertexIndex[0] = indices[0] & 0xFFFF;
+        vertexIndex[1] = indices[0] >> 16;
+        vertexIndex[2] = indices[1] & 0xFFFF;
+        vertexIndex[3] = indices[1] >> 16;
+    }
+}
+
 
 #endif
\ No newline at end of file
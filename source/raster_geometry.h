@@ -8,27 +8,70 @@
 typedef enum PolygonShadingType { 
     SHADING_FLAT_LIGHTING,
     SHADING_FLAT,
-    SHADING_WIREFRAME
+    SHADING_WIREFRAME,
+    SHADING_TEXTURED, // Affine texture mapping (unlit); falls back to SHADING_FLAT for models without a texture. 
+    SHADING_GOURAUD // Lighting per vertex, interpolated across the triangle (greyscale like SHADING_FLAT_LIGHTING); falls back to SHADING_FLAT_LIGHTING for models without vertex normals.
 } PolygonShadingType;
 
+/* 
+    Texture dimensions have to be powers of two (so we can wrap texture coordinates with a mask instead of a modulo). 
+    The texels are stored row after row.
+*/
+typedef struct Texture {
+    const COLOR *texels;
+    int widthLog2, heightLog2;
+} Texture;
+
+/* Texture coordinates; in .8 fixed point and normalised (0 to int2fx(1)) for models, in .8 fixed point texel units for RasterTriangles. */
+typedef struct TexCoord {
+    FIXED u, v;
+} TexCoord;
+
 
 /* 
     We use RASTER_POINT_NEAR_FAR_CULL as a special value for x and y when the raster point is behind the near plane or beyond the far plane. 
 */
-#define RASTER_POINT_NEAR_FAR_CULL INT16_MAX
+#define RASTER_POINT_NEAR_FAR_CULL INT32_MAX
+
+/* 
+    The vertices of RasterTriangles are in subpixel precision (fixed point with RASTER_SUBPIXEL_BITS fractional bits), 
+    so that vertices don't snap to whole pixels (which makes slowly moving models "wobble"). 
+    Pixel centres lie at whole numbers, i.e. the pixel (x, y) is filled if the point (x << RASTER_SUBPIXEL_BITS, y << RASTER_SUBPIXEL_BITS) lies within the triangle.
+    Four fractional bits are all the rasteriser needs (12.4); we still use 32-bit coordinates because the vertices of big triangles close to the camera 
+    can be much further off-screen than 2048 pixels. 
+    The 2d clipping functions (clipping.h) and drawPoints work with whole pixels (cf. RASTER_SUBPIXEL_TO_INT). 
+*/
+#define RASTER_SUBPIXEL_BITS 4
+#define RASTER_SUBPIXEL_ONE (1 << RASTER_SUBPIXEL_BITS)
+#define RASTER_SUBPIXEL_CEIL(n) (((n) + RASTER_SUBPIXEL_ONE - 1) >> RASTER_SUBPIXEL_BITS)
+#define RASTER_SUBPIXEL_TO_INT(n) (((n) + (RASTER_SUBPIXEL_ONE >> 1)) >> RASTER_SUBPIXEL_BITS) // The pixel a subpixel coordinate lies in.
+// Converts a FIXED screen coordinate (where pixel x covers [x, x + 1)) to a subpixel coordinate (where the centre of pixel x is at x).
+#define FIXED_2_RASTER_SUBPIXEL(n) (((n) - (1 << (FIX_SHIFT - 1))) >> (FIX_SHIFT - RASTER_SUBPIXEL_BITS))
 
 typedef struct RasterPoint { 
-    s16 x, y; 
+    s32 x, y; 
 } ALIGN4 RasterPoint; 
 
+#define RASTER_MAX_VERTS 4
+
+/* Despite the name, RasterTriangles can also be convex quads (cf. ConvexPlanarQuadFace in model.h), so we can draw those in one go. */
 typedef struct RasterTriangle {
-    RasterPoint vert[3];
+    RasterPoint vert[RASTER_MAX_VERTS];
+    int numVerts; // 3, or 4 for quads.
     FIXED centroidZ;
     COLOR color;
     PolygonShadingType shading;
+    const Texture *texture; // Only for SHADING_TEXTURED.
+    TexCoord texCoord[RASTER_MAX_VERTS]; // Only for SHADING_TEXTURED.
+    FIXED intensity[RASTER_MAX_VERTS]; // Only for SHADING_GOURAUD; the grey level (1 to 31) of each vertex.
     struct RasterTriangle* next; // For our ordering table in draw.c
 } ALIGN4 RasterTriangle;
 
+typedef struct RasterLine { // An edge of a wireframe model (cf. Edge in model.h); unlike the triangles, its end points are in whole pixels.
+    RasterPoint a, b;
+    COLOR color;
+} ALIGN4 RasterLine;
+
 typedef struct Triangle {
     Vec3 vert[3];
     FIXED centroidZ;
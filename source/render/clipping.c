@@ -8,125 +8,6 @@
 #include "../logutils.h"
 #include "../model.h"
 
-#define RASTERPOINT_IN_BOUNDS_M5(vert) (vert.x >= 0 && vert.x < M5_SCALED_W && vert.y >= 0 && vert.y < M5_SCALED_H)
-
-typedef enum ClipEdges {
-    TOP_EDGE=0,
-    BOTTOM_EDGE, 
-    LEFT_EDGE, 
-    RIGHT_EDGE
-} ClipEdges;
-
-/* 
-    Calculates line intersections against the screen borders, used for 2d clipping.
-    Invariant: To be called only when the given intersection actually exists, which is the case for our use case. 
-    (But otherwise, the assertions should catch the divisions by zero in those cases).  
-    cf. https://www.cs.helsinki.fi/group/goa/viewing/leikkaus/intro2.html
-    (Their code doesn't take into account division by zero explicity, as they use 1/slope for the top/bottom intersect; my code does by calculating the invslope directly.)
-*/
-static RasterPoint calcIntersect2d(ClipEdges edge, RasterPoint current, RasterPoint prev) 
-{ 
-    RasterPoint inter;
-    FIXED slope, invslope;
-    switch (edge) {
-        case LEFT_EDGE:
-            assertion(current.x - prev.x !=0, "calcIntersect div 0");
-            slope = fxdiv(int2fx(current.y - prev.y), int2fx(current.x - prev.x));
-            inter.x = 0;
-            inter.y = fx2int(fxmul(slope, 0 - int2fx(prev.x)) + int2fx(prev.y));
-            break;
-        case RIGHT_EDGE:
-            assertion(current.x - prev.x !=0, "calcIntersect div 0");
-            slope = fxdiv(int2fx(current.y - prev.y), int2fx(current.x - prev.x));
-            inter.x = M5_SCALED_W - 1;
-            inter.y = fx2int(fxmul(slope, int2fx(M5_SCALED_W - 1) - int2fx(prev.x)) + int2fx(prev.y));
-            break;
-        case TOP_EDGE:
-            assertion(current.y - prev.y !=0, "calcIntersect div 0");
-            invslope = fxdiv(int2fx(current.x - prev.x), int2fx(current.y - prev.y));
-            inter.y = 0;
-            inter.x = fx2int(fxmul(0 - int2fx(prev.y), invslope) + int2fx(prev.x));
-            break;
-        case BOTTOM_EDGE:
-            assertion(current.y - prev.y !=0, "calcIntersect div 0");
-            invslope = fxdiv(int2fx(current.x - prev.x), int2fx(current.y - prev.y));
-            inter.y = M5_SCALED_H - 1;
-            inter.x = fx2int(fxmul(int2fx(M5_SCALED_H - 1) - int2fx(prev.y), invslope) + int2fx(prev.x));
-            break;
-        default:
-            panic("calcIntersect: unknown edge");
-    }
-    return inter;
-}
-
-
-/* 
-    Used by the Sutherland Hodgman Clipping against the Screen. 
-    Returns true if the given point lies on the same side of the given screen's edge as the remainder of the screen. 
-    This does *not* imply the point actually lies within the screen, that would be incorrect for the purposes of the Sutherland-Hodgman algorithm. 
-*/
-INLINE bool inside_clip(RasterPoint point, ClipEdges edge) 
-{
-
-    switch(edge) {
-        case TOP_EDGE:
-            return point.y >= 0; 
-            break;
-        case BOTTOM_EDGE:
-            return point.y < M5_SCALED_H;
-            break;
-        case LEFT_EDGE: 
-            return point.x >= 0;
-            break;
-        case RIGHT_EDGE:
-            return point.x < M5_SCALED_W;
-            break;
-        default:
-            panic("unknown clipping edge");
-            return false;
-    }
-}
-
-/*  
-    cf. https://en.wikipedia.org/wiki/Sutherland–Hodgman_algorithm
-*/
-int clipTriangleVerts2d(RasterPoint outputVertices[CLIPPING_MAX_POLY_LEN]) 
-{
-    int outputLen = 3;
-    RasterPoint inputList[CLIPPING_MAX_POLY_LEN];
-
-    for (int edge = 0; edge < 4; ++edge) { 
-        memcpy(inputList, outputVertices, sizeof(RasterPoint) * outputLen);
-        int inputLen = outputLen;
-        outputLen = 0;
-        for (int i = 0; i < inputLen; ++i) {
-            RasterPoint prev = inputList[i];
-            RasterPoint current = inputList[(i + 1) % inputLen];
-            if (inside_clip(current, edge)) {
-                if (!inside_clip(prev, edge) ) {
-                    assertion(outputLen < CLIPPING_MAX_POLY_LEN, "output len 1");
-                    outputVertices[outputLen++] = calcIntersect2d(edge, current, prev);
-                }
-                assertion(outputLen < CLIPPING_MAX_POLY_LEN, "output len 1");
-                outputVertices[outputLen++] = current;
-            } else if (inside_clip(prev, edge)) { 
-                assertion(outputLen < CLIPPING_MAX_POLY_LEN, "output len 2");
-                outputVertices[outputLen++] = calcIntersect2d(edge, current, prev);
-            }
-        }  
-    }     
-    /* 
-        This is just a sanity check/assertion; the algorithm should not yield out of bounds vertices.
-        Note that we can only check this after the algorithm has terminated, as the intermediate steps can yield intermediary out-of-screen vertices. 
-        Checking for out-of-screen vertices while we haven't constructed the final outputVertices array *does not make sense* due to the nature of S-H-clipping. 
-    */ 
-    for (int i = 0; i < outputLen; ++i) { 
-        assertion(RASTERPOINT_IN_BOUNDS_M5(outputVertices[i]), "draw.c: clipTriangleVerts2d: Vertex within screen bounds");
-    }
-    return outputLen; 
-}
-
-
 /* 
     The following code is copied more or less line by line (no pun intended) from the English wikipedia article
     on Cohen-Sutherland line-cliping (with minor modifications), and therefore licensed under the
@@ -145,18 +26,30 @@ INLINE OutCode computeOutcode(const RasterPoint *a)
     OutCode code = INSIDE; 
     if (a->x < 0) {
         code |= LEFT;
-    } else if (a->x >= M5_SCALED_W) {
+    } else if (a->x >= g_canvasWidth) {
         code |= RIGHT;
     }
     if (a->y < 0) {
         code |= TOP;
-    } else if (a->y >= M5_SCALED_H) {
+    } else if (a->y >= g_canvasHeight) {
         code |= BOTTOM;
     }
     return code;
 }
 
-bool clipLineCohenSutherland(RasterPoint *a, RasterPoint *b) 
+/* 
+    Returns a + da * t / dt in integer arithmetic (rounded towards a). The products of lines which fit on (or near) the screen fit into 32 bits; 
+    only the rare lines with vertices far off-screen need the 64-bit multiplication.
+*/
+INLINE int clipLerp(int a, int da, int t, int dt) 
+{
+    if (da > -(1 << 15) && da < (1 << 15) && t > -(1 << 15) && t < (1 << 15)) {
+        return a + da * t / dt;
+    }
+    return a + (int)((s64)da * t / dt);
+}
+
+IWRAM_CODE_ARM bool clipLineCohenSutherland(RasterPoint *a, RasterPoint *b) 
 {  
     OutCode outcodeA = computeOutcode(a);
     OutCode outcodeB = computeOutcode(b);
@@ -170,20 +63,21 @@ bool clipLineCohenSutherland(RasterPoint *a, RasterPoint *b)
         } 
         OutCode outside = outcodeA > outcodeB ? outcodeA : outcodeB; // One of the vertices must be outside, select that one. 
         int x, y;
+        // Integer arithmetic only (the vertices are whole pixels, so we don't need fixed point for the intersections).
         if (outside & TOP) {
             // (x2 - x1) / (y2 - y1) = (x - x1) / (y - y1)  
             y = 0;
-            x = a->x + fx2int(fxmul(fxdiv(int2fx(b->x - a->x), int2fx(b->y - a->y)), 0 - int2fx(a->y)));
+            x = clipLerp(a->x, b->x - a->x, y - a->y, b->y - a->y);
         } else if (outside & BOTTOM) {
-            y = M5_SCALED_H - 1;
-            x = a->x + fx2int(fxmul(fxdiv(int2fx(b->x - a->x), int2fx(b->y - a->y)), int2fx(y) - int2fx(a->y)));
+            y = g_canvasHeight - 1;
+            x = clipLerp(a->x, b->x - a->x, y - a->y, b->y - a->y);
         } else if (outside & LEFT) {
             // (y2 - y1) / (x2 - x1) = (y - y1) / (x - x1) 
             x = 0;
-            y = a->y + fx2int(fxmul(fxdiv(int2fx(b->y - a->y), int2fx(b->x - a->x)), int2fx(x) - int2fx(a->x)));
+            y = clipLerp(a->y, b->y - a->y, x - a->x, b->x - a->x);
         } else if (outside & RIGHT) {
-            x = M5_SCALED_W - 1;
-            y = a->y + fx2int(fxmul(fxdiv(int2fx(b->y - a->y), int2fx(b->x - a->x)), int2fx(x) - int2fx(a->x)));
+            x = g_canvasWidth - 1;
+            y = clipLerp(a->y, b->y - a->y, x - a->x, b->x - a->x);
         } else {
             panic("clipping.c: clipLineCohenSutherland: Programming error; no clip intersection.");
         }
@@ -204,3 +98,131 @@ bool clipLineCohenSutherland(RasterPoint *a, RasterPoint *b)
         }
     }
 }
+
+typedef enum ClipEdges {
+    TOP_EDGE=0,
+    BOTTOM_EDGE, 
+    LEFT_EDGE, 
+    RIGHT_EDGE
+} ClipEdges;
+
+/* 
+    Used by the Sutherland-Hodgman clipping against the rectangle. 
+    Returns true if the given point lies on the same side of the given edge as the remainder of the rectangle. 
+    This does *not* imply the point actually lies within the rectangle, that would be incorrect for the purposes of the Sutherland-Hodgman algorithm. 
+*/
+INLINE bool clipInside2d(RasterPoint point, ClipEdges edge, const int bounds[4]) 
+{
+    switch (edge) {
+        case TOP_EDGE:
+            return point.y >= bounds[TOP_EDGE]; 
+        case BOTTOM_EDGE:
+            return point.y <= bounds[BOTTOM_EDGE];
+        case LEFT_EDGE: 
+            return point.x >= bounds[LEFT_EDGE];
+        case RIGHT_EDGE:
+            return point.x <= bounds[RIGHT_EDGE];
+        default:
+            panic("clipping.c: clipInside2d: unknown clipping edge");
+            return false;
+    }
+}
+
+/* 
+    The intersection of the edge from a to b with the given edge of the rectangle (which has to exist). 
+    We always interpolate from the same end point of an edge (the upper one), so triangles sharing an edge get exactly the same intersection. 
+*/
+static ClipVertex2d clipIntersect2d(const ClipVertex2d *a, const ClipVertex2d *b, ClipEdges edge, const int bounds[4]) 
+{
+    if (b->pos.y < a->pos.y || (b->pos.y == a->pos.y && b->pos.x < a->pos.x)) {
+        const ClipVertex2d *tmp = a; a = b; b = tmp;
+    }
+    const bool vertical = edge == LEFT_EDGE || edge == RIGHT_EDGE; // The edge of the rectangle, that is.
+    const int t = vertical ? bounds[edge] - a->pos.x : bounds[edge] - a->pos.y;
+    const int dt = vertical ? b->pos.x - a->pos.x : b->pos.y - a->pos.y;
+    assertion(dt != 0, "clipping.c: clipIntersect2d: dt != 0");
+    ClipVertex2d inter;
+    if (vertical) {
+        inter.pos.x = bounds[edge];
+        inter.pos.y = clipLerp(a->pos.y, b->pos.y - a->pos.y, t, dt);
+    } else {
+        inter.pos.x = clipLerp(a->pos.x, b->pos.x - a->pos.x, t, dt);
+        inter.pos.y = bounds[edge];
+    }
+    inter.texCoord.u = clipLerp(a->texCoord.u, b->texCoord.u - a->texCoord.u, t, dt);
+    inter.texCoord.v = clipLerp(a->texCoord.v, b->texCoord.v - a->texCoord.v, t, dt);
+    inter.intensity = clipLerp(a->intensity, b->intensity - a->intensity, t, dt);
+    return inter;
+}
+
+/*  
+    cf. https://en.wikipedia.org/wiki/Sutherland–Hodgman_algorithm
+*/
+IWRAM_CODE_ARM int clipTriangleVerts2d(const RasterTriangle *tri, int numVerts, int left, int top, int right, int bottom, ClipVertex2d outputVertices[CLIPPING_MAX_POLY_LEN]) 
+{
+    const int bounds[4] = {[TOP_EDGE]=top, [BOTTOM_EDGE]=bottom, [LEFT_EDGE]=left, [RIGHT_EDGE]=right};
+    int outputLen = numVerts;
+    const bool attributes = tri->shading == SHADING_TEXTURED || tri->shading == SHADING_GOURAUD; // (The other triangles leave them uninitialised.)
+    for (int i = 0; i < outputLen; ++i) {
+        outputVertices[i].pos = tri->vert[i];
+        outputVertices[i].texCoord = attributes ? tri->texCoord[i] : (TexCoord){0, 0};
+        outputVertices[i].intensity = attributes ? tri->intensity[i] : 0;
+    }
+    ClipVertex2d inputList[CLIPPING_MAX_POLY_LEN];
+
+    for (int edge = 0; edge < 4; ++edge) { 
+        memcpy(inputList, outputVertices, sizeof(ClipVertex2d) * outputLen);
+        const int inputLen = outputLen;
+        outputLen = 0;
+        for (int i = 0; i < inputLen; ++i) {
+            const ClipVertex2d *prev = inputList + i;
+            const ClipVertex2d *current = inputList + (i + 1 == inputLen ? 0 : i + 1);
+            if (clipInside2d(current->pos, edge, bounds)) {
+                if (!clipInside2d(prev->pos, edge, bounds)) {
+                    assertion(outputLen < CLIPPING_MAX_POLY_LEN, "clipping.c: clipTriangleVerts2d: outputLen < CLIPPING_MAX_POLY_LEN (1)");
+                    outputVertices[outputLen++] = clipIntersect2d(current, prev, edge, bounds);
+                }
+                assertion(outputLen < CLIPPING_MAX_POLY_LEN, "clipping.c: clipTriangleVerts2d: outputLen < CLIPPING_MAX_POLY_LEN (2)");
+                outputVertices[outputLen++] = *current;
+            } else if (clipInside2d(prev->pos, edge, bounds)) { 
+                assertion(outputLen < CLIPPING_MAX_POLY_LEN, "clipping.c: clipTriangleVerts2d: outputLen < CLIPPING_MAX_POLY_LEN (3)");
+                outputVertices[outputLen++] = clipIntersect2d(current, prev, edge, bounds);
+            }
+        }  
+        if (outputLen < 3) { // Nothing left.
+            return 0;
+        }
+    }     
+    return outputLen; 
+}
+
+/* The point where the edge from a (in front of the near plane) to b (behind it) crosses the plane; t in .16 fixed point, as the camera space coordinates of big faces are much larger than the distance to the near plane. */
+INLINE ClipVertex clipVertexNear(const ClipVertex *a, const ClipVertex *b, FIXED nearZ) 
+{
+    const s32 t = (s32)(((s64)(nearZ - a->pos.z) << 16) / (b->pos.z - a->pos.z));
+    ClipVertex v;
+    v.pos.x = a->pos.x + (FIXED)(((s64)(b->pos.x - a->pos.x) * t) >> 16);
+    v.pos.y = a->pos.y + (FIXED)(((s64)(b->pos.y - a->pos.y) * t) >> 16);
+    v.pos.z = nearZ;
+    v.texCoord.u = a->texCoord.u + (FIXED)(((s64)(b->texCoord.u - a->texCoord.u) * t) >> 16);
+    v.texCoord.v = a->texCoord.v + (FIXED)(((s64)(b->texCoord.v - a->texCoord.v) * t) >> 16);
+    v.intensity = a->intensity + (FIXED)(((s64)(b->intensity - a->intensity) * t) >> 16);
+    return v;
+}
+
+IWRAM_CODE_ARM int clipTriangleNear(const ClipVertex in[3], ClipVertex out[4], FIXED nearZ) 
+{
+    int n = 0;
+    for (int i = 0; i < 3; ++i) {
+        const ClipVertex *a = in + i;
+        const ClipVertex *b = in + (i == 2 ? 0 : i + 1);
+        const bool aInside = a->pos.z <= nearZ, bInside = b->pos.z <= nearZ;
+        if (aInside) {
+            out[n++] = *a;
+        }
+        if (aInside != bInside) { // We always interpolate from the vertex in front, so both directions of a shared edge yield the same point.
+            out[n++] = aInside ? clipVertexNear(a, b, nearZ) : clipVertexNear(b, a, nearZ);
+        }
+    }
+    return n < 3 ? 0 : n;
+}
@@ -3,16 +3,35 @@
 
 #include "../raster_geometry.h"
 
-#define CLIPPING_MAX_POLY_LEN 12 // Very conservative; when clipping a triangle against the screen, we should get at most 7 vertices for the clipped n-gon.
+#define CLIPPING_MAX_POLY_LEN 12 // Very conservative; when clipping a quad against the rectangle, we get at most 8 vertices for the clipped n-gon.
 
 /*
-    Sutherland-Hodgman Polygon clipping against the screen. 
-    Takes outputVertices (with index 0 to 3 filled by the triangle which we want to clip against the screen), and modifies it to contain the vertices of the n-gon clipped to the screen from 0 to n - 1.  
-    Returns the number of vertices n of the clipped n-gon that are contained in outputVertices from 0 to n -1 (can be zero if the triangle is not visible on the screen after clipping). 
+    Sutherland-Hodgman clipping of the first numVerts vertices of a RasterTriangle (3, or 4 for quads) against a rectangle (inclusive bounds in subpixels, cf. raster_geometry.h), used for the guard band of the rasterisers (cf. rasteriser.h).
+    The texture coordinates and intensities are interpolated along the edges, which doesn't change the image, as the rasterisers interpolate them affinely anyway. 
+    Writes the vertices of the clipped (convex) n-gon to outputVertices, and returns n (zero if nothing of the triangle is left).
 */
-int clipTriangleVerts2d(RasterPoint outputVertices[CLIPPING_MAX_POLY_LEN]); 
+typedef struct ClipVertex2d {
+    RasterPoint pos;
+    TexCoord texCoord;
+    FIXED intensity;
+} ClipVertex2d;
 
-/* Returns true if the resulting line is visible on the screen. */
+int clipTriangleVerts2d(const RasterTriangle *tri, int numVerts, int left, int top, int right, int bottom, ClipVertex2d outputVertices[CLIPPING_MAX_POLY_LEN]); 
+
+/* Returns true if the resulting line is visible on the screen. Note: Unlike the vertices of RasterTriangles, the end points of the lines are in whole pixels (cf. RASTER_SUBPIXEL_TO_INT). */
 bool clipLineCohenSutherland(RasterPoint *a, RasterPoint *b);
 
+/*
+    Near-plane clipping in camera space (before the projection): Sutherland-Hodgman against the single plane z = nearZ (the camera looks down -z, so the visible side is z <= nearZ).
+    A triangle which is partly behind the plane becomes a triangle or a convex quad (i.e. at most two triangles); the texture coordinates and intensities are interpolated along. 
+    Returns the number of vertices written to out (0 if the triangle is completely behind the plane). 
+*/
+typedef struct ClipVertex {
+    Vec3 pos; // In camera space.
+    TexCoord texCoord;
+    FIXED intensity;
+} ClipVertex;
+
+int clipTriangleNear(const ClipVertex in[3], ClipVertex out[4], FIXED nearZ);
+
 #endif
\ No newline at end of file
@@ -1,5 +1,6 @@
 #include <string.h>
 #include <stdlib.h>
+#include <limits.h>
 #include <tonc.h>
 
 #include "../globals.h"
@@ -11,15 +12,21 @@
 #include "draw.h"
 #include "clipping.h"
 #include "rasteriser.h"
+#include "sbuffer.h"
+#include "tilebuffer.h"
+#include "line.h"
+#include "transformcache.h"
 
-#define RASTERPOINT_IN_BOUNDS_M5(vert) (vert.x >= 0 && vert.x < M5_SCALED_W && vert.y >= 0 && vert.y < M5_SCALED_H)
-#define BEHIND_NEAR(vert) (vert.z > -cam->near ) // True if the Vec3 is behind the near plane of the camera (i.e. invisible).
-#define BEYOND_FAR(vert) (vert.z < -cam->far)
+#define RASTERPOINT_IN_BOUNDS(vert) (vert.x >= 0 && vert.x < g_canvasWidth && vert.y >= 0 && vert.y < g_canvasHeight)
 
 #define DRAW_MAX_TRIANGLES 512
 EWRAM_DATA static RasterTriangle screenTriangles[DRAW_MAX_TRIANGLES]; 
 static int screenTriangleCount = 0;
 
+#define DRAW_MAX_LINES 1024
+EWRAM_DATA static RasterLine screenLines[DRAW_MAX_LINES]; 
+static int screenLineCount = 0;
+
 /*
     With an ordering table, we can avoid expensive sorting. Basically just an array containing linked lists for each depth value.
     We sacrifice memory usage (and accuracy, i.e. Polygons which are a certain cutoff distance from each other are drawn in indeterminate order, but it should not matter) for speed. 
@@ -31,22 +38,34 @@ static int screenTriangleCount = 0;
 static RasterTriangle *orderingTable[OT_SIZE]; // TODO: We might have to put this into EWRAM to save space in IWRAM...
 
 static int perfFill, perfModelProcessing, perfTotal, perfProject;
+static DrawHiddenSurfaceMode hiddenSurfaceMode = HSR_PAINTERS;
+static COLOR tileClearColor = CLR_BLACK;
+static int shadingDowngrade = 0; // cf. drawSetShadingDowngrade
+static int pointStride = 1; // cf. drawSetPointStride
+static int cullFrames, cullInstancesTested, cullInstancesCulled; // Frustum culling statistics since the last drawPrintCullingStats.
+static int cullMeshletsTested, cullMeshletsCulled; // (The meshlets of the instances which weren't culled, cf. meshletTest.)
+
+// Dirty rectangles (cf. drawDirtyRect): What we've drawn on each of the two pages, and what has to be restored on the current page this frame.
+static DrawRect pageDirtyRects[2];
+static DrawRect *dirtyRect = pageDirtyRects; // The one of the page we're drawing to (set by drawBefore).
+static DrawRect restoreRect;
+#define DIRTY_RECT_DMA_MIN_WIDTH 32 // Rows at least that wide are filled with DMA3 (for narrower ones, it's not worth setting up the transfer).
 
 /* 
     Scaling using the affine background capabilities of the GBA. 
-    We use Mode 5 (160x128) with an "internal/logical" resolution of 160x100 scaled to fit the 
+    We use Mode 5 (160x128) with an "internal/logical" resolution of 160x100 (by default, cf. drawSetResolution) scaled to fit the 
     240x160 (factor 1.5) screen of the GBA (with 5px letterboxes on the top and bottom). 
 */
 void setDispScaleM5Scaled(void) 
 {
 
-    FIXED threeHalfInv = 170; // 170 is about (3/2)^-1 in .8 fixed point.
+    FIXED scaleInv = (g_canvasWidth << FIX_SHIFT) / SCREEN_WIDTH; // 170 (about (3/2)^-1 in .8 fixed point) for 160x100.
     AFF_SRC_EX asx= {
         .alpha=0,
-        .sx=threeHalfInv,
-        .sy=threeHalfInv,
+        .sx=scaleInv,
+        .sy=scaleInv,
         .scr_x=0,
-        .scr_y=5, // Vertical letterboxing.
+        .scr_y=(SCREEN_HEIGHT - g_canvasHeight * SCREEN_WIDTH / g_canvasWidth) / 2, // Vertical letterboxing.
         .tex_x=0,
         .tex_y=0 
     };
@@ -90,23 +109,188 @@ static void updateMode(void)
     // cf. https://gist.github.com/zeichensystem/0729edcddf8f24db14e5b1b4ef4c0c3f (last retrieved 2021-05-23)
 }
 
+/* We don't know what's on the pages after a mode switch (or after another scene), so everything has to be restored. */
+static void resetDirtyRects(void) 
+{
+    pageDirtyRects[0] = pageDirtyRects[1] = restoreRect = (DrawRect){.left=0, .top=0, .right=g_canvasWidth, .bottom=g_canvasHeight};
+}
+
 void videoM5ScaledInit(void) 
 {
     g_mode = DCNT_MODE5;
     updateMode();
+    hiddenSurfaceMode = HSR_PAINTERS;
+    shadingDowngrade = 0;
+    pointStride = 1;
+    drawSetResolution(M5_SCALED_W, M5_SCALED_H);
+}
+
+void drawSetResolution(int width, int height) 
+{
+    assertion(g_mode == DCNT_MODE5, "draw.c: drawSetResolution: Only in mode 5");
+    assertion(width > 0 && width <= M5_SCALED_W && height > 0 && height <= M5_SCALED_H && !(width & 1), "draw.c: drawSetResolution: Invalid resolution");
+    assertion(height * SCREEN_WIDTH / width <= SCREEN_HEIGHT, "draw.c: drawSetResolution: Taller than the screen when scaled");
+    g_canvasWidth = width;
+    g_canvasHeight = height;
     setDispScaleM5Scaled();
+    // The letterboxes show the rows of the page below the canvas, so we clear both pages completely. 
+    memset32(vid_mem_front, 0, (M5_WIDTH * M5_HEIGHT) / 2);
+    memset32(vid_mem_back, 0, (M5_WIDTH * M5_HEIGHT) / 2);
+    resetDirtyRects();
 }
 
 void videoM4Init(void) 
 {
     g_mode = DCNT_MODE4;
+    g_canvasWidth = M4_WIDTH;
+    g_canvasHeight = M4_HEIGHT;
     updateMode();
     resetDispScale();
+    hiddenSurfaceMode = HSR_PAINTERS;
+    shadingDowngrade = 0;
+    pointStride = 1;
+    resetDirtyRects();
+}
+
+void setM4Pal3d(void) 
+{
+    for (int level = 0; level < 32; ++level) {
+        pal_bg_mem[M4_PAL_GREY(level)] = RGB15(level, level, level);
+    }
+    for (int r = 0; r < M4_PAL_CUBE_LEVELS; ++r) {
+        for (int g = 0; g < M4_PAL_CUBE_LEVELS; ++g) {
+            for (int b = 0; b < M4_PAL_CUBE_LEVELS; ++b) {
+                const int max = M4_PAL_CUBE_LEVELS - 1;
+                pal_bg_mem[M4_PAL_CUBE + (r * M4_PAL_CUBE_LEVELS + g) * M4_PAL_CUBE_LEVELS + b] = RGB15(r * 31 / max, g * 31 / max, b * 31 / max);
+            }
+        }
+    }
+}
+
+/* The colour to draw a face (or line/point) of the given RGB15 colour with: The colour itself in mode 5, and the nearest entry of the colour cube of our palette in mode 4. */
+INLINE COLOR drawColor(COLOR clr) 
+{
+    if (g_mode != DCNT_MODE4) {
+        return clr;
+    }
+    #define M4_PAL_CUBE_LEVEL(c) (((c) * (M4_PAL_CUBE_LEVELS - 1) + 15) / 31) // The nearest level for a 5-bit channel.
+    const int r = M4_PAL_CUBE_LEVEL(clr & 31), g = M4_PAL_CUBE_LEVEL((clr >> 5) & 31), b = M4_PAL_CUBE_LEVEL((clr >> 10) & 31);
+    #undef M4_PAL_CUBE_LEVEL
+    return M4_PAL_CUBE + (r * M4_PAL_CUBE_LEVELS + g) * M4_PAL_CUBE_LEVELS + b;
+}
+
+/* The colour of the grey level (0 to 31) of our lighting: RGB15(level, level, level) in mode 5, and the corresponding entry of the grey ramp in mode 4. */
+INLINE COLOR drawGrey(int level) 
+{
+    return g_mode == DCNT_MODE4 ? M4_PAL_GREY(level) : RGB15(level, level, level);
+}
+
+INLINE void drawLine(int x1, int y1, int x2, int y2, COLOR clr) 
+{
+    if (g_mode == DCNT_MODE4) {
+        m4_line_bresenham(x1, y1, x2, y2, clr);
+    } else {
+        m5_line_bresenham(x1, y1, x2, y2, clr);
+    }
+}
+
+void drawSetHiddenSurfaceMode(DrawHiddenSurfaceMode mode) 
+{
+    hiddenSurfaceMode = mode;
+}
+
+void drawSetTileClearColor(COLOR clr) 
+{
+    tileClearColor = clr;
+}
+
+void drawSetShadingDowngrade(int steps) 
+{
+    assertion(steps >= 0, "draw.c: drawSetShadingDowngrade: steps >= 0");
+    shadingDowngrade = steps;
+}
+
+void drawSetPointStride(int stride) 
+{
+    assertion(stride >= 1, "draw.c: drawSetPointStride: stride >= 1");
+    pointStride = stride;
+}
+
+/* The shading an instance is drawn with after shadingDowngrade steps down the ladder (Gouraud -> flat lighting -> flat -> wireframe; textured -> flat). */
+static PolygonShadingType drawShading(PolygonShadingType shading) 
+{
+    for (int step = 0; step < shadingDowngrade; ++step) {
+        switch (shading) {
+        case SHADING_GOURAUD:
+            shading = SHADING_FLAT_LIGHTING;
+            break;
+        case SHADING_FLAT_LIGHTING:
+        case SHADING_TEXTURED:
+            shading = SHADING_FLAT;
+            break;
+        default:
+            return SHADING_WIREFRAME;
+        }
+    }
+    return shading;
 }
 
 IWRAM_CODE_ARM void m5ScaledFill(COLOR clr) 
 {
-    memset32(vid_page, dup16(clr), ((M5_SCALED_H-0) * M5_SCALED_W)/2);
+    if (g_canvasWidth == M5_WIDTH) {
+        memset32(vid_page, dup16(clr), (g_canvasHeight * M5_WIDTH) / 2);
+        return;
+    }
+    for (int y = 0; y < g_canvasHeight; ++y) { // (Our canvas width is even.)
+        memset32(vid_page + y * M5_WIDTH, dup16(clr), g_canvasWidth / 2);
+    }
+}
+
+void drawMarkDirty(int left, int top, int right, int bottom) 
+{
+    left = MAX(left, 0);
+    top = MAX(top, 0);
+    right = MIN(right, g_canvasWidth);
+    bottom = MIN(bottom, g_canvasHeight);
+    if (left >= right || top >= bottom) {
+        return;
+    }
+    if (dirtyRect->left >= dirtyRect->right) { // Still empty this frame.
+        *dirtyRect = (DrawRect){.left=left, .top=top, .right=right, .bottom=bottom};
+        return;
+    }
+    dirtyRect->left = MIN(dirtyRect->left, left);
+    dirtyRect->top = MIN(dirtyRect->top, top);
+    dirtyRect->right = MAX(dirtyRect->right, right);
+    dirtyRect->bottom = MAX(dirtyRect->bottom, bottom);
+}
+
+DrawRect drawDirtyRect(void) 
+{
+    return restoreRect;
+}
+
+IWRAM_CODE_ARM void m5ScaledClearDirty(COLOR clr) 
+{
+    if (restoreRect.left >= restoreRect.right) {
+        return;
+    }
+    // Round to whole words (the background is plain, so filling a pixel too much doesn't matter); the width of the canvas is even.
+    const int left = restoreRect.left & ~1;
+    const int width = ((restoreRect.right + 1) & ~1) - left;
+    const u32 fill = dup16(clr);
+    COLOR *dst = vid_page + restoreRect.top * M5_WIDTH + left;
+    if (width == M5_WIDTH) { // Whole rows are contiguous, so we can clear all of them with one transfer.
+        dma3_fill(dst, fill, (restoreRect.bottom - restoreRect.top) * M5_WIDTH * sizeof(COLOR));
+        return;
+    }
+    for (int y = restoreRect.top; y < restoreRect.bottom; ++y, dst += M5_WIDTH) {
+        if (width >= DIRTY_RECT_DMA_MIN_WIDTH) {
+            dma3_fill(dst, fill, width * sizeof(COLOR));
+        } else {
+            memset32(dst, fill, width / 2);
+        }
+    }
 }
 
 
@@ -114,6 +298,7 @@ void drawInit(void)
 {
     REG_DISPCNT = g_mode | DCNT_BG2;
     txt_init_std();
+    slopeLutInit();
     perfFill = performanceDataRegister("draw.c: rasterisation");
     perfModelProcessing = performanceDataRegister("draw:c pre-rasterisation");
     perfTotal = performanceDataRegister("draw.c: total");
@@ -123,53 +308,86 @@ void drawInit(void)
 
 IWRAM_CODE_ARM void drawBefore(Camera *cam) 
 { 
+    if (cam->canvasWidth != int2fx(g_canvasWidth) || cam->canvasHeight != int2fx(g_canvasHeight)) { // The render resolution (or mode) changed since the camera was set up.
+        cameraSetCanvas(cam, g_canvasWidth, g_canvasHeight);
+    }
     cameraComputeWorldToCamSpace(cam);
+    // The page we're about to draw to still holds what we've drawn on it two frames ago, which is what has to be restored now.
+    dirtyRect = pageDirtyRects + (vid_page == vid_mem_front ? 0 : 1);
+    restoreRect = *dirtyRect;
+    *dirtyRect = (DrawRect){0};
 }
 
 
+#define DRAW_POINTS_BATCH 32 // drawPoints transforms that many points at once (into buffers on the stack).
+
 IWRAM_CODE_ARM void drawPoints(const Camera *cam, Vec3 *points, int num, COLOR clr) 
 {
-    for (int i = 0; i < num; ++i) {
-        Vec3 pointCamSpace = vecTransformed(cam->world2cam, points[i]);
-        if (BEHIND_NEAR(pointCamSpace) || BEYOND_FAR(pointCamSpace)) { 
-            continue;
-        }
- 
-        FIXED const z = -pointCamSpace.z;
-        FIXED pre_divide_x = fxmul(cam->perspFacX, pointCamSpace.x);
-        if (pre_divide_x < -z || pre_divide_x > z ) {// Check if the point is to the left/right of the viewing frustum before dividing (to save unnecessary divisions in those cases).  
-            continue;
-        }
-        FIXED pre_divide_y = fxmul(cam->perspFacY, pointCamSpace.y);
-        if (pre_divide_y < -z|| pre_divide_y > z ) { // Check if the point is to the top/bottom of the viewing frustum. 
-            continue;
-        }
-        RasterPoint rp = {
-            .x=fx2int( fxmul(cam->viewportTransFacX, fxdiv(pre_divide_x, z)) + cam->viewportTransAddX ),
-            .y=fx2int( fxmul(cam->viewportTransFacY, fxdiv(pre_divide_y, z)) + cam->viewportTransAddY )
-        };
-        if (RASTERPOINT_IN_BOUNDS_M5(rp)) { 
-            m5_plot(rp.x, rp.y, clr);
+    clr = drawColor(clr);
+    Matrix3x4 world2cam;
+    matrix3x4createAffine(&world2cam, cam->world2cam);
+    for (int first = 0; first < num; first += DRAW_POINTS_BATCH * pointStride) {
+        Vec3 pointsCamSpace[DRAW_POINTS_BATCH];
+        u8 outcodes[DRAW_POINTS_BATCH];
+        const int count = MIN(DRAW_POINTS_BATCH, (num - first + pointStride - 1) / pointStride);
+        vecTransformBatch3x4(&world2cam, points + first, pointsCamSpace, outcodes, count, pointStride, cam->near, cam->far);
+        for (int i = 0; i < count; ++i) {
+            if (outcodes[i]) { // Behind the near or beyond the far plane.
+                continue;
+            }
+            const Vec3 pointCamSpace = pointsCamSpace[i];
+            FIXED const z = -pointCamSpace.z;
+            FIXED pre_divide_x = fxmul(cam->perspFacX, pointCamSpace.x);
+            if (pre_divide_x < -z || pre_divide_x > z ) {// Check if the point is to the left/right of the viewing frustum before dividing (to save unnecessary divisions in those cases).  
+                continue;
+            }
+            FIXED pre_divide_y = fxmul(cam->perspFacY, pointCamSpace.y);
+            if (pre_divide_y < -z|| pre_divide_y > z ) { // Check if the point is to the top/bottom of the viewing frustum. 
+                continue;
+            }
+            const FxReciprocal invZ = fxReciprocal(z);
+            RasterPoint rp = {
+                .x=fx2int( fxmul(cam->viewportTransFacX, fxmulReciprocal(pre_divide_x, invZ)) + cam->viewportTransAddX ),
+                .y=fx2int( fxmul(cam->viewportTransFacY, fxmulReciprocal(pre_divide_y, invZ)) + cam->viewportTransAddY )
+            };
+            if (RASTERPOINT_IN_BOUNDS(rp)) { 
+                drawMarkDirty(rp.x, rp.y, rp.x + 1, rp.y + 1);
+                if (g_mode == DCNT_MODE4) {
+                    m4_plot(rp.x, rp.y, clr);
+                } else {
+                    m5_plot(rp.x, rp.y, clr);
+                }
+            }
         }
     }
 }
 
 IWRAM_CODE_ARM void drawTriangleWireframe(const RasterTriangle *tri) 
 { 
-    // (This function is pretty slow for some reason. FIXME please.)
-    if (!RASTERPOINT_IN_BOUNDS_M5(tri->vert[0]) || !RASTERPOINT_IN_BOUNDS_M5(tri->vert[1]) || !RASTERPOINT_IN_BOUNDS_M5(tri->vert[2])) { // We have to clip against the screen.
-        for (int j = 0; j < 3; ++j) {
-            int nextIdx = (j + 1) < 3 ? j + 1 : 0;
-            RasterPoint a = tri->vert[j];
-            RasterPoint b = tri->vert[nextIdx];
+    // (This outlines every face, so edges shared by two faces are drawn twice; models with an edge list don't come here, cf. drawLines.)
+    const int n = tri->numVerts;
+    RasterPoint vert[RASTER_MAX_VERTS]; // Lines are drawn between whole pixels.
+    for (int j = 0; j < n; ++j) {
+        vert[j].x = RASTER_SUBPIXEL_TO_INT(tri->vert[j].x);
+        vert[j].y = RASTER_SUBPIXEL_TO_INT(tri->vert[j].y);
+    }
+    bool inBounds = true;
+    for (int j = 0; j < n; ++j) {
+        inBounds = inBounds && RASTERPOINT_IN_BOUNDS(vert[j]);
+    }
+    if (!inBounds) { // We have to clip against the screen.
+        for (int j = 0; j < n; ++j) {
+            int nextIdx = (j + 1) < n ? j + 1 : 0;
+            RasterPoint a = vert[j];
+            RasterPoint b = vert[nextIdx];
             if (clipLineCohenSutherland(&a, &b)) {
-                m5_line(a.x, a.y, b.x, b.y, tri->color);
+                drawLine(a.x, a.y, b.x, b.y, tri->color);
             }
         }
     } else { // No clipping necessary.
-        for (int j = 0; j < 3; ++j) {
-            int nextIdx = (j + 1) < 3 ? j + 1 : 0;
-            m5_line(tri->vert[j].x, tri->vert[j].y, tri->vert[nextIdx].x,tri-> vert[nextIdx].y, tri->color);
+        for (int j = 0; j < n; ++j) {
+            int nextIdx = (j + 1) < n ? j + 1 : 0;
+            drawLine(vert[j].x, vert[j].y, vert[nextIdx].x, vert[nextIdx].y, tri->color);
         }
     }
 }
@@ -180,10 +398,13 @@ IWRAM_CODE_ARM void drawTriangleWireframe(const RasterTriangle *tri)
     I'm sorry. 
 */
 #define INSTANCE_CALC_LIGHTDIR_AND_ATTENUATION()                                                                                                                            \
-        PolygonShadingType instanceShading = instance->state.shading;                                                                                                       \
+        PolygonShadingType instanceShading = drawShading(instance->state.shading);                                                                                          \
+        if (instanceShading == SHADING_GOURAUD && mod->vertNormals == NULL) {                                                                                               \
+            instanceShading = SHADING_FLAT_LIGHTING;                                                                                                                        \
+        }                                                                                                                                                                   \
         Vec3 lightDir;                                                                                                                                                      \
         FIXED attenuation = -1;                                                                                                                                             \
-        if (instanceShading == SHADING_FLAT_LIGHTING) {                                                                                                                     \
+        if (instanceShading == SHADING_FLAT_LIGHTING || instanceShading == SHADING_GOURAUD) {                                                                               \
             if (lightDat.type == LIGHT_POINT) {                                                                                                                             \
                 Vec3 dir = vecSub(*lightDat.light.point, instance->state.pos);                                                                                              \
                 if (lightDat.attenuation != NULL) {                                                                                                                         \
@@ -198,6 +419,7 @@ IWRAM_CODE_ARM void drawTriangleWireframe(const RasterTriangle *tri)
             } else {                                                                                                                                                        \
                 panic("draw.c: drawModelInstaces: Missing lighting vectors.");                                                                                              \
             }                                                                                                                                                               \
+            lightDir = vecTransformedRotInverse(instanceRotMat, lightDir); /* We light in model space, so the normals don't have to be rotated. */                          \
         }                                                                                                                                                                   \
 
 #define FACE_CALC_COLOR() {                                                                                                     \
@@ -209,18 +431,39 @@ IWRAM_CODE_ARM void drawTriangleWireframe(const RasterTriangle *tri)
                 shade = fx2int(fxmul(attenuation, int2fx(shade)));                                                              \
             }                                                                                                                   \
             shade = MIN(MAX(1, shade), 31);                                                                                     \
-            screenTri.color = RGB15(shade, shade, shade);                                                                       \
+            screenTri.color = drawGrey(shade);                                                                                  \
         } else {                                                                                                                \
-            screenTri.color = RGB15(1,1,1);                                                                                     \
+            screenTri.color = drawGrey(1);                                                                                      \
+        }                                                                                                                       \
+    } else if (instanceShading == SHADING_GOURAUD) { /* Lit once per vertex (and cached for the other faces sharing the vertex). */ \
+        for (int i = 0; i < screenTri.numVerts; ++i) {                                                                          \
+            const int vertIdx = vertexIndex[i];                                                                                 \
+            if (vertsIntensity[vertIdx] < 0) {                                                                                  \
+                vertsIntensity[vertIdx] = calcIntensity(vecDot(lightDir, unpackNormal(mod->vertNormals[vertIdx])), attenuation);\
+            }                                                                                                                   \
+            screenTri.intensity[i] = vertsIntensity[vertIdx];                                                                   \
         }                                                                                                                       \
-    } else if (instanceShading == SHADING_FLAT || instanceShading == SHADING_WIREFRAME) {                                       \
-        screenTri.color = face.color;                                                                                           \
+    } else if (instanceShading == SHADING_FLAT || instanceShading == SHADING_WIREFRAME || instanceShading == SHADING_TEXTURED) { \
+        screenTri.color = drawColor(face.color);                                                                                \
     } else {                                                                                                                    \
         panic("draw.c: drawModelInstances: Unknown shading option.");                                                           \
     }                                                                                                                           \
 }                                                                                                                               \
 
 
+/* The grey level (.8 fixed point, 1 to 31) for SHADING_GOURAUD vertices, analogous to the face colours of SHADING_FLAT_LIGHTING. */
+INLINE FIXED calcIntensity(FIXED lightAlpha, FIXED attenuation) 
+{
+    if (lightAlpha <= 0) {
+        return int2fx(1);
+    }
+    FIXED intensity = fxmul(lightAlpha, int2fx(31));
+    if (attenuation != -1) {
+        intensity = fxmul(attenuation, intensity);
+    }
+    return MIN(MAX(int2fx(1), intensity), int2fx(31));
+}
+
 INLINE void otInsert(RasterTriangle *t) 
 {
     int idx = ABS(t->centroidZ) >> (FIX_SHIFT - 1); // We have a granularity of 0.5; polygons that have a smaller z-distance will be drawn in indeterminate order.
@@ -233,10 +476,217 @@ INLINE void otInsert(RasterTriangle *t)
     orderingTable[idx] = t;
 }     
 
+/* 
+    fxmul for the viewport transform: Vertices just in front of the near plane (e.g. the ones of clipped faces) can be projected very far off screen,
+    where the product doesn't fit into 32 bits anymore (the 2d clipping in the rasteriser copes with the large coordinates, but not with overflowed ones).
+*/
+INLINE FIXED viewportMul(FIXED fac, FIXED ndc) 
+{
+    if (ndc > -(1 << 16) && ndc < (1 << 16)) {
+        return fxmul(fac, ndc);
+    }
+    const s64 product = ((s64)fac * ndc) >> FIX_SHIFT;
+    return (FIXED)MIN(MAX(product, -(1 << 30)), 1 << 30);
+}
+
+/* 
+    Perspective projection and screen space transform of a vertex in camera space (in front of the near plane) to subpixel coordinates.
+    We do it manually instead of just calling vecTransformed(cam->perspMat, v) for performance (for my test case with 414 triangles: 20.2 ms vs 24.4 ms)
+*/
+INLINE RasterPoint projectVertex(const Camera *cam, Vec3 v) 
+{
+    // One reciprocal per vertex for both axes instead of two divisions (cf. fxReciprocal).
+    const FxReciprocal invZ = fxReciprocal(-v.z);
+    // x =  ( ((cam->viewportTransFacX * (cam->perspFacX * v.x / -z)) >> FIX_SHIFT) + cam->viewportTransAddX) >> FIX_SHIFT; (not much faster)
+    return (RasterPoint){
+        .x=FIXED_2_RASTER_SUBPIXEL( viewportMul(cam->viewportTransFacX, fxmulReciprocal(fxmul(cam->perspFacX, v.x), invZ) ) + cam->viewportTransAddX ),
+        .y=FIXED_2_RASTER_SUBPIXEL( viewportMul(cam->viewportTransFacY, fxmulReciprocal(fxmul(cam->perspFacY, v.y), invZ) ) + cam->viewportTransAddY )
+    };
+}
+
+/* The screen borders a (projected) vertex is outside of, as bits (left, right, top, bottom). */
+INLINE int screenOutcode(RasterPoint vert) 
+{
+    return (vert.x < 0) | ((vert.x >= (g_canvasWidth << RASTER_SUBPIXEL_BITS)) << 1) | ((vert.y < 0) << 2) | ((vert.y >= (g_canvasHeight << RASTER_SUBPIXEL_BITS)) << 3);
+}
+
+/* The centre of the bounding sphere of the instance in world space. */
+INLINE Vec3 instanceBoundsCenter(const ModelInstance *instance, const FIXED instanceRotMat[16]) 
+{
+    const Model *mod = &instance->state.mod;
+    Vec3 center = {.x=fxmul(mod->boundsCenter.x, instance->state.scale.x), .y=fxmul(mod->boundsCenter.y, instance->state.scale.y), .z=fxmul(mod->boundsCenter.z, instance->state.scale.z)};
+    vecTransform(instanceRotMat, &center);
+    return vecAdd(center, instance->state.pos);
+}
+
+typedef enum FrustumTest {
+    FRUSTUM_OUTSIDE,
+    FRUSTUM_INTERSECTS,
+    FRUSTUM_INSIDE
+} FrustumTest;
+
+/* Tests a sphere in camera space against the six planes of the view frustum. */
+INLINE FrustumTest frustumTestSphere(const Camera *cam, Vec3 center, FIXED radius) 
+{
+    // The signed distances of the centre to the planes (positive: outside). The camera looks down the negative z-axis.
+    const FIXED sideX = fxmul(cam->frustumRight.x, center.x), sideY = fxmul(cam->frustumTop.y, center.y);
+    const FIXED distRight = sideX + fxmul(cam->frustumRight.z, center.z), distLeft = -sideX + fxmul(cam->frustumRight.z, center.z);
+    const FIXED distTop = sideY + fxmul(cam->frustumTop.z, center.z), distBottom = -sideY + fxmul(cam->frustumTop.z, center.z);
+    const FIXED distNear = center.z + cam->near, distFar = -cam->far - center.z;
+    const FIXED distMax = MAX(MAX(MAX(distRight, distLeft), MAX(distTop, distBottom)), MAX(distNear, distFar));
+    const FIXED slack = (ABS(center.x) + ABS(center.y) + ABS(center.z)) >> (FIX_SHIFT - 1); // The plane normals are only .8 fixed point, so we allow for their rounding error.
+    if (distMax > radius + slack) {
+        return FRUSTUM_OUTSIDE;
+    }
+    return distMax < -radius - slack ? FRUSTUM_INSIDE : FRUSTUM_INTERSECTS;
+}
+
+/* 
+    Tests the bounding sphere of the instance (scaled by its largest scale factor) against the view frustum, before any of its vertices are transformed. 
+    If it's completely outside of any plane, the instance is culled; if it's completely inside of all of them, none of its vertices can be 
+    behind the near plane, beyond the far plane, or off screen, so we don't have to check that for each vertex and face. 
+    Sets the camSpaceDepth of the instance as well. center is the one of the bounding sphere in world space (cf. instanceBoundsCenter).
+*/
+INLINE FrustumTest instanceFrustumTest(const Camera *cam, ModelInstance *instance, Vec3 center, FIXED maxScale) 
+{
+    const Model *mod = &instance->state.mod;
+    vecTransform(cam->world2cam, &center);
+    instance->state.camSpaceDepth = -center.z;
+    if (mod->boundsRadius < 0) { // The model doesn't have a bounding sphere (its centre is the origin of the model then).
+        return FRUSTUM_INTERSECTS;
+    }
+    return frustumTestSphere(cam, center, fxmul(mod->boundsRadius, maxScale));
+}
+
+/* 
+    Culls a meshlet (cf. Meshlet in model.h) before any of its faces or vertices are touched: FRUSTUM_OUTSIDE if its bounding sphere is outside of the view frustum, 
+    or (with backface culling) if none of its faces can face the camera; FRUSTUM_INSIDE if its faces don't need the per-vertex frustum checks. 
+    The cone test happens in model space, like the backface culling of the faces: With d the direction from the camera to the centre of the meshlet, 
+    all faces face away from the camera if dot(d, coneAxis) >= coneCutoff * |d| + radius. We compare the squares of both sides instead, 
+    so we don't need a square root (in 64 bits, as |d|^2 doesn't fit into 32 bits for far away meshlets). 
+*/
+INLINE FrustumTest meshletTest(const Camera *cam, const Meshlet *meshlet, const Matrix3x4 *model2cam, FIXED maxScale, bool backfaceCulling, Vec3 camModelSpace) 
+{
+    if (backfaceCulling) {
+        const Vec3 d = vecSub(meshlet->center, camModelSpace);
+        const FIXED ahead = vecDot(d, meshlet->coneAxis) - meshlet->radius; 
+        if (ahead > 0) {
+            const s64 distSq = (s64)d.x * d.x + (s64)d.y * d.y + (s64)d.z * d.z; // .16
+            if (((s64)ahead * ahead << (2 * FIX_SHIFT)) >= (s64)meshlet->coneCutoff * meshlet->coneCutoff * distSq) {
+                return FRUSTUM_OUTSIDE;
+            }
+        }
+    }
+    return frustumTestSphere(cam, vecTransformed3x4(model2cam, meshlet->center), fxmul(meshlet->radius, maxScale));
+}
+
 // We put it outside of "modelInstancesPrepareDraw" to not exhaust the stack (I think). Will be slower I think. Ugh.
 static EWRAM_DATA Vec3 vertsCamSpace[MAX_MODEL_VERTS];
-static EWRAM_DATA Vec3 vertsWorldSpace[MAX_MODEL_VERTS];
 static EWRAM_DATA RasterPoint vertsProjected[MAX_MODEL_VERTS];
+static EWRAM_DATA FIXED vertsIntensity[MAX_MODEL_VERTS]; // Per-vertex lighting cache for SHADING_GOURAUD (negative if not calculated yet for the current instance).
+static EWRAM_DATA u8 vertsOutcode[MAX_MODEL_VERTS]; // cf. VERTEX_OUTCODE_NEAR
+// For models with meshlets, only the vertices of the faces which survive the culling are transformed (when they're first needed): The ones whose stamp is the current one.
+static EWRAM_DATA u16 vertsPrepared[MAX_MODEL_VERTS];
+static u16 vertsPreparedStamp;
+
+/* Projects vertex i (which has been transformed to camera space already) unless it's behind the near or beyond the far plane, and grows the bounds of the projected vertices. */
+INLINE void projectTransformedVertex(const Camera *cam, int i, bool inFrustum, RasterPoint *projectedMin, RasterPoint *projectedMax) 
+{
+    vertsIntensity[i] = -1; 
+    if (!inFrustum && vertsOutcode[i]) {  
+        vertsProjected[i].x = RASTER_POINT_NEAR_FAR_CULL;
+        vertsProjected[i].y = RASTER_POINT_NEAR_FAR_CULL;
+    } else {
+        vertsProjected[i] = projectVertex(cam, vertsCamSpace[i]);
+        projectedMin->x = MIN(projectedMin->x, vertsProjected[i].x);
+        projectedMin->y = MIN(projectedMin->y, vertsProjected[i].y);
+        projectedMax->x = MAX(projectedMax->x, vertsProjected[i].x);
+        projectedMax->y = MAX(projectedMax->y, vertsProjected[i].y);
+    }
+}
+
+/* 
+    Transforms vertex i of mod to camera space and projects it. (All vertices of a model at once are transformed with vecTransformPackedBatch3x4 instead, which yields the same.) 
+    verts2cam is the transform of the packed vertices, cf. packedVerts2cam.
+*/
+INLINE void prepareVertex(const Camera *cam, const Matrix3x4 *verts2cam, const Model *mod, int i, bool inFrustum, RasterPoint *projectedMin, RasterPoint *projectedMax) 
+{
+    const PackedVec3 v = mod->verts[i];
+    vertsCamSpace[i] = vecTransformed3x4(verts2cam, (Vec3){.x=v.x, .y=v.y, .z=v.z});
+    vertsOutcode[i] = vertexOutcode(vertsCamSpace[i], cam->near, cam->far);
+    projectTransformedVertex(cam, i, inFrustum, projectedMin, projectedMax);
+}
+
+/* 
+    The model to camera space transform of the packed vertices of mod, which are shifted right by vertShift: We shift the matrix left instead, which is exact 
+    (the translation stays as it is). The .16 entries have room for that, unless a model with very large vertices is scaled up a lot, too.
+*/
+INLINE void packedVerts2cam(Matrix3x4 *verts2cam, const Matrix3x4 *model2cam, const Model *mod)
+{
+    *verts2cam = *model2cam;
+    if (mod->vertShift) {
+        for (int i = 0; i < 9; ++i) {
+            verts2cam->linear[i] *= 1 << mod->vertShift;
+        }
+    }
+}
+
+/* Everything we draw of an instance lies within the bounds of its (projected) vertices, conservatively rounded to whole pixels (cf. raster_geometry.h). */
+INLINE void markDirtyProjected(RasterPoint projectedMin, RasterPoint projectedMax) 
+{
+    if (projectedMin.x != INT_MAX) {
+        drawMarkDirty(projectedMin.x >> RASTER_SUBPIXEL_BITS, projectedMin.y >> RASTER_SUBPIXEL_BITS, RASTER_SUBPIXEL_TO_INT(projectedMax.x) + 1, RASTER_SUBPIXEL_TO_INT(projectedMax.y) + 1);
+    }
+}
+/*
+    Near-plane clipping of a face with vertices behind the near plane (cf. clipTriangleNear), so big faces close to the camera don't pop out of existence.
+    screenTri has everything but the vertices, i.e. the colour and the texture coordinates/intensities of the face's vertices. 
+    Quads are split into two triangles first, each of which yields a triangle or a convex quad. 
+    Only the faces which actually cross the near plane come here; all the others don't pay anything for the clipping. 
+*/
+IWRAM_CODE_ARM static void faceClipNear(const Camera *cam, const int vertexIndex[FACE_MAX_VERTS], const RasterTriangle *screenTri) 
+{
+    // Only textured and Gouraud-shaded faces have texture coordinates and intensities (the others leave them uninitialised, so we must not interpolate them).
+    const bool attributes = screenTri->shading == SHADING_TEXTURED || screenTri->shading == SHADING_GOURAUD;
+    for (int half = 0; half < screenTri->numVerts - 2; ++half) { // Quads: (0, 1, 2) and (0, 2, 3).
+        ClipVertex in[3], out[4];
+        for (int i = 0; i < 3; ++i) {
+            const int vert = i ? half + i : 0;
+            in[i].pos = vertsCamSpace[vertexIndex[vert]];
+            in[i].texCoord = attributes ? screenTri->texCoord[vert] : (TexCoord){0, 0};
+            in[i].intensity = attributes ? screenTri->intensity[vert] : 0;
+        }
+        const int numVerts = clipTriangleNear(in, out, -cam->near);
+        if (!numVerts) {
+            continue;
+        }
+        RasterTriangle tri = *screenTri;
+        tri.numVerts = numVerts;
+        int outside = ~0;
+        FIXED zSum = 0;
+        RasterPoint projectedMin = {.x=INT_MAX, .y=INT_MAX}, projectedMax = {.x=INT_MIN, .y=INT_MIN};
+        for (int i = 0; i < numVerts; ++i) {
+            tri.vert[i] = projectVertex(cam, out[i].pos);
+            tri.texCoord[i] = out[i].texCoord;
+            tri.intensity[i] = out[i].intensity;
+            outside &= screenOutcode(tri.vert[i]);
+            zSum += out[i].pos.z;
+            projectedMin.x = MIN(projectedMin.x, tri.vert[i].x);
+            projectedMin.y = MIN(projectedMin.y, tri.vert[i].y);
+            projectedMax.x = MAX(projectedMax.x, tri.vert[i].x);
+            projectedMax.y = MAX(projectedMax.y, tri.vert[i].y);
+        }
+        if (outside) {
+            continue;
+        }
+        tri.centroidZ = zSum / numVerts;
+        drawMarkDirty(projectedMin.x >> RASTER_SUBPIXEL_BITS, projectedMin.y >> RASTER_SUBPIXEL_BITS, RASTER_SUBPIXEL_TO_INT(projectedMax.x) + 1, RASTER_SUBPIXEL_TO_INT(projectedMax.y) + 1);
+        assertion(screenTriangleCount < DRAW_MAX_TRIANGLES, "draw.c: faceClipNear: screenTriangleCount < DRAW_MAX_TRIANGLES");
+        screenTriangles[screenTriangleCount++] = tri;
+        otInsert(screenTriangles + (screenTriangleCount - 1));
+    }
+}
+
 /* 
     Performs model to camera space transformations, perspective projection, and shading/lighting calculations.
     Calculates the screen-space triangles which can be drawn later. We put them into the ordering table, so we don't have to sort them. 
@@ -245,90 +695,186 @@ IWRAM_CODE_ARM static void modelInstancesPrepareDraw(Camera* cam, ModelInstance
 { 
     for (int instanceNum = 0; instanceNum < numInstances; ++instanceNum) {
         ModelInstance *instance = instances + instanceNum;
-        if (instance->isEmpty) {
+        if (instance->isEmpty || instance->state.hidden) {
             continue;
         }
-        // TODO: Insert bounding-sphere culling here.
-        FIXED instanceRotMat[16];
-        matrix4x4createYawPitchRoll(instanceRotMat, instance->state.yaw, instance->state.pitch, instance->state.roll);
-
-
-        for (int i = 0; i < instance->state.mod.numVerts; ++i) {
-            // Model space to world space:
-            vertsCamSpace[i].x = fxmul(instance->state.mod.verts[i].x, instance->state.scale.x); 
-            vertsCamSpace[i].y = fxmul(instance->state.mod.verts[i].y, instance->state.scale.y);
-            vertsCamSpace[i].z = fxmul(instance->state.mod.verts[i].z, instance->state.scale.z);
-            vecTransform(instanceRotMat, vertsCamSpace + i );
-            // We translate manually so that instanceRotMat stays as is (so we can rotate our normals with the instanceRotMat in model space to calculate lighting):
-            vertsCamSpace[i].x += instance->state.pos.x;
-            vertsCamSpace[i].y += instance->state.pos.y;
-            vertsCamSpace[i].z += instance->state.pos.z;
-            vertsWorldSpace[i] = vertsCamSpace[i];
-            vecTransform(cam->world2cam, vertsCamSpace + i); // And finally, we're in camera space.
-            if (BEHIND_NEAR(vertsCamSpace[i]) || BEYOND_FAR(vertsCamSpace[i])) {  
-                vertsProjected[i].x = RASTER_POINT_NEAR_FAR_CULL;
-                vertsProjected[i].y = RASTER_POINT_NEAR_FAR_CULL;
-            } else {
-                // Perspective projection and screen space transform; we do it manually instead of just calling vecTransformed(cam->perspMat, vertsCamSpace[i]) for performance (for my test case with 414 triangles: 20.2 ms vs 24.4 ms)
-                const FIXED z = vertsCamSpace[i].z;
-                // vertsProjected[i].x =  ( ((cam->viewportTransFacX * (cam->perspFacX * vertsCamSpace[i].x / -z)) >> FIX_SHIFT) + cam->viewportTransAddX) >> FIX_SHIFT; (not much faster)
-                vertsProjected[i].x = fx2int( fxmul(cam->viewportTransFacX, fxdiv(fxmul(cam->perspFacX, vertsCamSpace[i].x), -z) ) + cam->viewportTransAddX );
-                vertsProjected[i].y = fx2int( fxmul(cam->viewportTransFacY, fxdiv(fxmul(cam->perspFacY, vertsCamSpace[i].y), -z) ) + cam->viewportTransAddY );
+        // Instances which haven't moved since the last frame have their rotation and bounds cached (cf. render/transformcache.h).
+        transformCacheTrack(instance);
+        TransformCacheEntry *cache = transformCacheGet(instance);
+        FIXED instanceRotMatStorage[16];
+        FIXED *instanceRotMat = cache != NULL ? cache->rotation : instanceRotMatStorage;
+        Vec3 boundsCenter;
+        if (cache != NULL && cache->valid) {
+            boundsCenter = cache->boundsCenter;
+        } else {
+            matrix4x4createYawPitchRoll(instanceRotMat, instance->state.yaw, instance->state.pitch, instance->state.roll);
+            boundsCenter = instanceBoundsCenter(instance, instanceRotMat);
+            if (cache != NULL) {
+                cache->boundsCenter = boundsCenter;
+                cache->valid = true;
             }
         }
+        const FIXED maxScale = MAX(ABS(instance->state.scale.x), MAX(ABS(instance->state.scale.y), ABS(instance->state.scale.z)));
+        const FrustumTest frustum = instanceFrustumTest(cam, instance, boundsCenter, maxScale);
+        ++cullInstancesTested;
+        if (frustum == FRUSTUM_OUTSIDE) {
+            ++cullInstancesCulled;
+            continue;
+        }
+        const bool inFrustum = frustum == FRUSTUM_INSIDE;
+        const Model *mod = &instance->state.mod; // The level of detail we draw (cf. modelSetLod).
+        while (mod->lod != NULL && instance->state.camSpaceDepth > fxmul(mod->lodDistance, maxScale)) {
+            mod = mod->lod;
+        }
+        // Scale, rotation, translation and the camera transform in one matrix, so the vertices go from model space to camera space directly (and never visit world space).
+        Matrix3x4 model2cam;
+        matrix3x4createTransform(&model2cam, cam->world2cam, instanceRotMat, instance->state.scale, instance->state.pos);
+        Matrix3x4 verts2cam;
+        packedVerts2cam(&verts2cam, &model2cam, mod);
+        RasterPoint projectedMin = {.x=INT_MAX, .y=INT_MAX}, projectedMax = {.x=INT_MIN, .y=INT_MIN}; // The bounds of the projected vertices (for the dirty rectangle). 
+        const bool nativeWireframe = drawShading(instance->state.shading) == SHADING_WIREFRAME && mod->edges != NULL;
+        const bool lazyVerts = mod->meshlets != NULL && !nativeWireframe; // (The edges don't know about meshlets.)
+
+        if (lazyVerts) {
+            if (++vertsPreparedStamp == 0) { // Wrapped around, the old stamps could be taken for current ones.
+                memset16(vertsPrepared, 0, MAX_MODEL_VERTS);
+                vertsPreparedStamp = 1;
+            }
+        } else {
+            vecTransformPackedBatch3x4(&verts2cam, mod->verts, vertsCamSpace, vertsOutcode, mod->numVerts, 1, cam->near, cam->far);
+            for (int i = 0; i < mod->numVerts; ++i) {
+                projectTransformedVertex(cam, i, inFrustum, &projectedMin, &projectedMax);
+            }
+            markDirtyProjected(projectedMin, projectedMax);
+        }
+ 
+        if (nativeWireframe) { // Native wireframe: We only need the (unique) edges, not the faces. 
+            for (int i = 0; i < mod->numEdges; ++i) {
+                const Edge *edge = mod->edges + i;
+                const RasterPoint a = vertsProjected[edge->vertexIndex[0]];
+                const RasterPoint b = vertsProjected[edge->vertexIndex[1]];
+                if ((a.x == RASTER_POINT_NEAR_FAR_CULL && a.y == RASTER_POINT_NEAR_FAR_CULL) || (b.x == RASTER_POINT_NEAR_FAR_CULL && b.y == RASTER_POINT_NEAR_FAR_CULL)) {
+                    continue; 
+                }
+                assertion(screenLineCount < DRAW_MAX_LINES, "draw.c: drawModelInstances: screenLineCount < DRAW_MAX_LINES");
+                RasterLine *line = screenLines + screenLineCount++;
+                line->a = (RasterPoint){.x=RASTER_SUBPIXEL_TO_INT(a.x), .y=RASTER_SUBPIXEL_TO_INT(a.y)};
+                line->b = (RasterPoint){.x=RASTER_SUBPIXEL_TO_INT(b.x), .y=RASTER_SUBPIXEL_TO_INT(b.y)};
+                line->color = drawColor(edge->color);
+            }
+            continue;
+        }
  
         // Calculate lightDir and attenuation (which don't depend on the faces, only on the instance) so we don't have to re-compute them redundantly in the inner loop over the faces.
         INSTANCE_CALC_LIGHTDIR_AND_ATTENUATION();
             
 
         const bool backfaceCulling = instance->state.backfaceCulling;
+        Vec3 camModelSpace = {0, 0, 0}; // The camera position in model space (the inverse of the instance's translation, rotation and scale), as the face normals are in model space.
+        if (backfaceCulling) {
+            camModelSpace = vecTransformedRotInverse(instanceRotMat, vecSub(cam->pos, instance->state.pos));
+            camModelSpace.x = fxdiv(camModelSpace.x, instance->state.scale.x);
+            camModelSpace.y = fxdiv(camModelSpace.y, instance->state.scale.y);
+            camModelSpace.z = fxdiv(camModelSpace.z, instance->state.scale.z);
+        }
 
-        for (int faceNum = 0; faceNum < instance->state.mod.numFaces; ++faceNum) { // For each face (triangle, really) of the ModelInstace. 
-            const Face face = instance->state.mod.faces[faceNum];
-
+        const Meshlet *meshlet = mod->meshlets; // The next meshlet, NULL if there are no more (or the model has none).
+        int meshletNum = 0;
+        bool facesInFrustum = inFrustum; // (The faces of a meshlet can be in the frustum even if the instance isn't.)
+        for (int faceNum = 0; faceNum < mod->numFaces; ++faceNum) { // For each face (triangle, really) of the ModelInstace. 
+            if (meshlet != NULL && faceNum == meshlet->firstFace) { // We might be able to skip all faces of the meshlet.
+                const FrustumTest meshletFrustum = inFrustum && !backfaceCulling ? FRUSTUM_INSIDE : meshletTest(cam, meshlet, &model2cam, maxScale, backfaceCulling, camModelSpace);
+                const int meshletFaces = meshlet->numFaces;
+                meshlet = ++meshletNum < mod->numMeshlets ? mod->meshlets + meshletNum : NULL;
+                ++cullMeshletsTested;
+                if (meshletFrustum == FRUSTUM_OUTSIDE) {
+                    ++cullMeshletsCulled;
+                    faceNum += meshletFaces - 1;
+                    continue;
+                }
+                facesInFrustum = inFrustum || meshletFrustum == FRUSTUM_INSIDE;
+            }
              // Backface culling (assumes a counter-clockwise winding order):
             // const Vec3 a = vecSub(vertsCamSpace[face.vertexIndex[1]], vertsCamSpace[face.vertexIndex[0]]);
             // const Vec3 b = vecSub(vertsCamSpace[face.vertexIndex[2]], vertsCamSpace[face.vertexIndex[0]]);
             // const Vec3 triNormal = vecCross(b, a);
             // const Vec3 camToTri = vertsCamSpace[face.vertexIndex[2]];
             
-            // Backface culling (with face normals, winding order does not matter):
-            const Vec3 triNormal = vecTransformedRot(instanceRotMat, &face.normal);
+            // Backface culling (with face normals and their plane distances, winding order does not matter). Culled faces don't read more than that from ROM.
             if (backfaceCulling) {
-                const Vec3 camToTri = vecSub(cam->pos, vertsWorldSpace[face.vertexIndex[0]]); 
-                if (vecDot(triNormal, camToTri) <= 0) { // If the angle between camera and normal is not between 90 degs and 270 degs, the face is invisible and to be culled.
+                const Face *plane = mod->faces + faceNum;
+                if (vecDot(unpackNormal(plane->normal), camModelSpace) <= plane->planeDist) { // If the camera is not in front of the plane of the face, the face is invisible and to be culled.
                     continue;
                 }
             }
+            const Face face = mod->faces[faceNum];
+            const Vec3 triNormal = unpackNormal(face.normal); // (In model space, like lightDir.)
+            int vertexIndex[FACE_MAX_VERTS];
+            modelFaceVertexIndices(mod, faceNum, vertexIndex);
 
             RasterTriangle screenTri; 
-            for (int i = 0; i < 3; ++i) {
-                screenTri.vert[i] = vertsProjected[face.vertexIndex[i]];
-                if (screenTri.vert[i].x == RASTER_POINT_NEAR_FAR_CULL && screenTri.vert[i].y == RASTER_POINT_NEAR_FAR_CULL) { // If the face is partly behind the near or far plane, cull the whole (we don't bother with clipping).
-                    goto skipFace;
+            screenTri.numVerts = face.type == ConvexPlanarQuadFace ? 4 : 3;
+            int outside = ~0; // The screen borders which *all* vertices of the face are outside of; if there are any, the face is invisible and we can skip it.
+            int behindNear = 0; // The number of vertices behind the near plane (the face has to be clipped if there are any).
+            for (int i = 0; i < screenTri.numVerts; ++i) {
+                const int vertIdx = vertexIndex[i];
+                if (lazyVerts && vertsPrepared[vertIdx] != vertsPreparedStamp) {
+                    vertsPrepared[vertIdx] = vertsPreparedStamp;
+                    prepareVertex(cam, &verts2cam, mod, vertIdx, inFrustum, &projectedMin, &projectedMax);
+                }
+                const RasterPoint vert = vertsProjected[vertIdx];
+                if (facesInFrustum) { // (The whole face is on screen.)
+                    outside = 0;
+                    screenTri.vert[i] = vert;
+                    continue;
+                }
+                if (vert.x == RASTER_POINT_NEAR_FAR_CULL && vert.y == RASTER_POINT_NEAR_FAR_CULL) { 
+                    if (vertsOutcode[vertIdx] & VERTEX_OUTCODE_FAR) { // If the face is partly beyond the far plane, cull the whole (we only clip against the near plane).
+                        goto skipFace;
+                    }
+                    ++behindNear;
+                    continue;
                 } 
+                outside &= screenOutcode(vert);
+                screenTri.vert[i] = vert;
             }
-               
-            // Check if all vertices of the face are to the "outside-side" of a given clipping plane. If so, the face is invisible and we can skip it.
-            if (screenTri.vert[0].x < 0 && screenTri.vert[1].x < 0 && screenTri.vert[2].x < 0) { // All vertices are to the left of the left-plane.
-                continue;
-            } else if (screenTri.vert[0].x >= M5_SCALED_W && screenTri.vert[1].x >= M5_SCALED_W && screenTri.vert[2].x >= M5_SCALED_W ) { // All vertices are to the right of the right-plane.
-                continue;
-            } else if (screenTri.vert[0].y < 0 && screenTri.vert[1].y < 0 && screenTri.vert[2].y < 0) { // All vertices are to the top of the top-plane.
-                continue;
-            } else if (screenTri.vert[0].y >= M5_SCALED_H && screenTri.vert[1].y >= M5_SCALED_H && screenTri.vert[2].y >= M5_SCALED_H) { // All vertices are to the bottom of the bottom-plane.
+            if (behindNear == screenTri.numVerts || (outside && !behindNear)) { // (The outcodes of the clipped face are only known after clipping.)
                 continue;
             }
 
             FACE_CALC_COLOR();
-            screenTri.shading = instance->state.shading;
-            screenTri.centroidZ = fxdiv(vertsCamSpace[face.vertexIndex[0]].z + vertsCamSpace[face.vertexIndex[1]].z + vertsCamSpace[face.vertexIndex[2]].z, int2fx(3)); 
+            screenTri.shading = instanceShading;
+            if (screenTri.shading == SHADING_TEXTURED) {
+                const Texture *texture = mod->texture;
+                if (texture && g_mode != DCNT_MODE4) { // Scale the normalised texture coordinates to texel units. (Our texels are RGB15, so we draw textured faces flat in mode 4.)
+                    const TexCoord *texCoords = mod->texCoords + faceNum * FACE_MAX_VERTS;
+                    for (int i = 0; i < screenTri.numVerts; ++i) {
+                        screenTri.texCoord[i].u = texCoords[i].u << texture->widthLog2;
+                        screenTri.texCoord[i].v = texCoords[i].v << texture->heightLog2;
+                    }
+                    screenTri.texture = texture;
+                } else {
+                    screenTri.shading = SHADING_FLAT;
+                }
+            }
+            if (behindNear) {
+                faceClipNear(cam, vertexIndex, &screenTri);
+                continue;
+            }
+            if (screenTri.numVerts == 4) {
+                screenTri.centroidZ = (vertsCamSpace[vertexIndex[0]].z + vertsCamSpace[vertexIndex[1]].z + vertsCamSpace[vertexIndex[2]].z + vertsCamSpace[vertexIndex[3]].z) >> 2; 
+            } else {
+                screenTri.centroidZ = fxdiv(vertsCamSpace[vertexIndex[0]].z + vertsCamSpace[vertexIndex[1]].z + vertsCamSpace[vertexIndex[2]].z, int2fx(3)); 
+            }
             assertion(screenTriangleCount < DRAW_MAX_TRIANGLES, "draw.c: drawModelInstances: screenTriangleCount < DRAW_MAX_TRIANGLES");
             screenTriangles[screenTriangleCount++] = screenTri;
             otInsert(screenTriangles + (screenTriangleCount - 1));
 
             skipFace:;
         }
+        if (lazyVerts) {
+            markDirtyProjected(projectedMin, projectedMax);
+        }
     }
 }
 #undef INSTANCE_CALC_LIGHTDIR_AND_ATTENUATION
@@ -342,6 +888,235 @@ IWRAM_CODE_ARM static void modelInstancesPrepareDraw(Camera* cam, ModelInstance
 //         return triA->centroidZ - triB->centroidZ; // Smaller/"more negative" z values mean the triangle is farther away from the camera.
 // }
 
+/* 
+    Flat quads are rasterised in one go, but textured and Gouraud-shaded quads are split into two triangles: 
+    A single set of constant gradients is only exact for triangles (the attributes of a quad on the screen aren't an affine function of x and y). 
+    The first triangle (0, 1, 2) is the quad itself (the triangle rasterisers only look at the first three vertices), this returns the second one (0, 2, 3).
+*/
+INLINE RasterTriangle quadSecondTriangle(const RasterTriangle *quad) 
+{
+    RasterTriangle tri = *quad;
+    tri.numVerts = 3;
+    tri.vert[1] = quad->vert[2];
+    tri.vert[2] = quad->vert[3];
+    tri.texCoord[1] = quad->texCoord[2];
+    tri.texCoord[2] = quad->texCoord[3];
+    tri.intensity[1] = quad->intensity[2];
+    tri.intensity[2] = quad->intensity[3];
+    return tri;
+}
+
+IWRAM_CODE_ARM static void drawOrderingTablePainters(void) 
+{
+    int trisToDraw = screenTriangleCount;
+    for (int i = OT_SIZE - 1; i >= 0 && trisToDraw; --i) { // Draw triangles from back to front by iterating over the ordering-table. 
+        for (RasterTriangle *t = orderingTable[i]; t != NULL; t = t->next) {
+            --trisToDraw;
+           if (t->shading == SHADING_FLAT || t->shading == SHADING_FLAT_LIGHTING) {
+                if (t->numVerts == 4) {
+                    rasterisePolygonFlat(t, m5_hline_nonorm);
+                } else {
+                    drawTriangleFlatByggmastar(t);
+                }
+            } else if (t->shading == SHADING_TEXTURED) {
+                rasteriseTriangleTextured(t, m5_texspan);
+                if (t->numVerts == 4) {
+                    const RasterTriangle second = quadSecondTriangle(t);
+                    rasteriseTriangleTextured(&second, m5_texspan);
+                }
+            } else if (t->shading == SHADING_GOURAUD) {
+                rasteriseTriangleGouraud(t, m5_gouraudspan);
+                if (t->numVerts == 4) {
+                    const RasterTriangle second = quadSecondTriangle(t);
+                    rasteriseTriangleGouraud(&second, m5_gouraudspan);
+                }
+            } else {
+                drawTriangleWireframe(t);
+            }
+       }
+    }
+}
+
+/* drawOrderingTablePainters for mode 4 (there are no textured triangles in mode 4, cf. modelInstancesPrepareDraw). */
+IWRAM_CODE_ARM static void drawOrderingTablePaintersM4(void) 
+{
+    int trisToDraw = screenTriangleCount;
+    for (int i = OT_SIZE - 1; i >= 0 && trisToDraw; --i) {
+        for (RasterTriangle *t = orderingTable[i]; t != NULL; t = t->next) {
+            --trisToDraw;
+            if (t->shading == SHADING_FLAT || t->shading == SHADING_FLAT_LIGHTING) {
+                if (t->numVerts == 4) {
+                    rasterisePolygonFlat(t, m4_hline_nonorm);
+                } else {
+                    rasteriseTriangleFlat(t, m4_hline_nonorm);
+                }
+            } else if (t->shading == SHADING_GOURAUD) {
+                rasteriseTriangleGouraud(t, m4_gouraudspan);
+                if (t->numVerts == 4) {
+                    const RasterTriangle second = quadSecondTriangle(t);
+                    rasteriseTriangleGouraud(&second, m4_gouraudspan);
+                }
+            } else {
+                drawTriangleWireframe(t);
+            }
+        }
+    }
+}
+
+/* 
+    Lines don't cover anything, so the modes which can't draw wireframe triangles in order draw them afterwards back to front on top of the filled triangles. 
+    (Which means wireframe triangles behind filled ones are not hidden; we don't mix both in the same scene anyway.)
+*/
+IWRAM_CODE_ARM static void drawOrderingTableWireframe(void) 
+{
+    for (int i = OT_SIZE - 1; i >= 0; --i) { 
+        for (RasterTriangle *t = orderingTable[i]; t != NULL; t = t->next) {
+            if (t->shading == SHADING_WIREFRAME) {
+                drawTriangleWireframe(t);
+            }
+        }
+    }
+}
+
+EWRAM_DATA static RasterTriangle *bucketReversed[DRAW_MAX_TRIANGLES];
+IWRAM_CODE_ARM static void drawOrderingTableSbuffer(void) 
+{
+    sbufferReset();
+    int trisToDraw = screenTriangleCount;
+    bool hasWireframe = false;
+    for (int i = 0; i < OT_SIZE && trisToDraw; ++i) { // Draw triangles from front to back by iterating over the ordering-table in reverse. 
+        /* 
+            The painter's algorithm draws the triangles of one OT-entry in list order, so the last one in the list "wins". 
+            We visit them in the reverse list order so both modes agree on the (otherwise indeterminate) order of triangles with (almost) the same depth.
+        */
+        int bucketLen = 0;
+        for (RasterTriangle *t = orderingTable[i]; t != NULL; t = t->next) {
+            bucketReversed[bucketLen++] = t;
+        }
+        trisToDraw -= bucketLen;
+        while (bucketLen--) {
+            const RasterTriangle *t = bucketReversed[bucketLen];
+            if (t->shading == SHADING_FLAT || t->shading == SHADING_FLAT_LIGHTING) {
+                if (t->numVerts == 4) {
+                    rasterisePolygonFlat(t, sbufferSpan);
+                } else {
+                    rasteriseTriangleFlat(t, sbufferSpan);
+                }
+            } else if (t->shading == SHADING_TEXTURED) {
+                rasteriseTriangleTextured(t, m5_texspan_sbuffer);
+                if (t->numVerts == 4) {
+                    const RasterTriangle second = quadSecondTriangle(t);
+                    rasteriseTriangleTextured(&second, m5_texspan_sbuffer);
+                }
+            } else if (t->shading == SHADING_GOURAUD) {
+                rasteriseTriangleGouraud(t, m5_gouraudspan_sbuffer);
+                if (t->numVerts == 4) {
+                    const RasterTriangle second = quadSecondTriangle(t);
+                    rasteriseTriangleGouraud(&second, m5_gouraudspan_sbuffer);
+                }
+            } else {
+                hasWireframe = true;
+            }
+        }
+        if (sbufferFull()) { // Every pixel is covered, everything else is hidden. 
+            break;
+        }
+    }
+    if (hasWireframe) {
+        drawOrderingTableWireframe();
+    }
+}
+
+/* 
+    Draws the ordering table tile by tile (cf. tilebuffer.h): All triangles are binned first (in back to front order), then each tile is rasterised 
+    like in drawOrderingTablePainters (just clipped to the tile) into the tile buffer, and copied to the page. 
+    Wireframe triangles are drawn on top afterwards, as in drawOrderingTableSbuffer. Returns false if there are too many triangles to bin (nothing is drawn then).
+*/
+IWRAM_CODE_ARM static bool drawOrderingTableTiled(void) 
+{
+    tileBinReset();
+    int trisToDraw = screenTriangleCount;
+    bool hasWireframe = false;
+    for (int i = OT_SIZE - 1; i >= 0 && trisToDraw; --i) {
+        for (RasterTriangle *t = orderingTable[i]; t != NULL; t = t->next) {
+            --trisToDraw;
+            if (t->shading == SHADING_WIREFRAME) {
+                hasWireframe = true;
+            } else if (!tileBinAdd(t)) {
+                return false;
+            }
+        }
+    }
+    const int tilesX = TILES_X(g_canvasWidth), tilesY = TILES_Y(g_canvasHeight);
+    for (int ty = 0; ty < tilesY; ++ty) {
+        for (int tx = 0; tx < tilesX; ++tx) {
+            int iter;
+            RasterTriangle *t = tileBinFirst(tx, ty, &iter);
+            if (t == NULL) {
+                tileFillEmpty(tx, ty, tileClearColor);
+                continue;
+            }
+            tileBufferBegin(tx, ty, tileClearColor);
+            rasterSetClip(tileBufferLeft, tileBufferTop, tileBufferLeft + tileBufferWidth, tileBufferTop + tileBufferHeight);
+            for (; t != NULL; t = tileBinNext(&iter)) {
+                if (t->shading == SHADING_FLAT || t->shading == SHADING_FLAT_LIGHTING) {
+                    if (t->numVerts == 4) {
+                        rasterisePolygonFlat(t, tile_hline_nonorm);
+                    } else {
+                        rasteriseTriangleFlat(t, tile_hline_nonorm);
+                    }
+                } else if (t->shading == SHADING_TEXTURED) {
+                    rasteriseTriangleTextured(t, tile_texspan);
+                    if (t->numVerts == 4) {
+                        const RasterTriangle second = quadSecondTriangle(t);
+                        rasteriseTriangleTextured(&second, tile_texspan);
+                    }
+                } else {
+                    rasteriseTriangleGouraud(t, tile_gouraudspan);
+                    if (t->numVerts == 4) {
+                        const RasterTriangle second = quadSecondTriangle(t);
+                        rasteriseTriangleGouraud(&second, tile_gouraudspan);
+                    }
+                }
+            }
+            tileBufferFlush();
+        }
+    }
+    rasterSetClip(0, 0, g_canvasWidth, g_canvasHeight);
+    if (hasWireframe) {
+        drawOrderingTableWireframe();
+    }
+    return true;
+}
+
+/* 
+    The edges of the wireframe models. Like the wireframe triangles in drawOrderingTableSbuffer, they're drawn on top of everything else (and in no particular order), 
+    as lines don't cover anything. The end points are projected only once per vertex, and each edge is clipped and drawn once.
+*/
+IWRAM_CODE_ARM static void drawLines(void) 
+{
+    for (int i = 0; i < screenLineCount; ++i) {
+        RasterLine line = screenLines[i];
+        if (clipLineCohenSutherland(&line.a, &line.b)) {
+            drawLine(line.a.x, line.a.y, line.b.x, line.b.y, line.color);
+        }
+    }
+}
+
+/* Prints how many instances were frustum culled per frame (on average) since the last call (cf. perfPrint), and how full the transform cache is. */
+void drawPrintCullingStats(void) 
+{
+    if (!cullFrames) {
+        return;
+    }
+    mgba_printf("Frustum culling: %d of %d instances culled per frame", cullInstancesCulled / cullFrames, cullInstancesTested / cullFrames);
+    mgba_printf("Meshlet culling: %d of %d meshlets culled per frame", cullMeshletsCulled / cullFrames, cullMeshletsTested / cullFrames);
+    mgba_printf("S-buffer overflows: %d spans not recorded in %d frames", sbufferTakeOverflows(), cullFrames); // Should be 0, otherwise spans behind them might overwrite them.
+    mgba_printf("Transform cache: %d of %d bytes used", transformCacheBytesUsed(), TRANSFORM_CACHE_ARENA_SIZE);
+    cullFrames = cullInstancesTested = cullInstancesCulled = 0;
+    cullMeshletsTested = cullMeshletsCulled = 0;
+}
+
 IWRAM_CODE_ARM void drawModelInstancePools(ModelInstancePool *pools, int numPools, Camera *cam, ModelDrawLightingData lightDat) 
 {
 
@@ -351,35 +1126,47 @@ IWRAM_CODE_ARM void drawModelInstancePools(ModelInstancePool *pools, int numPool
     }
 
     screenTriangleCount = 0;
+    screenLineCount = 0;
     performanceStart(perfModelProcessing);
+    ++cullFrames;
     for (int i = 0; i < numPools; ++i) { 
         modelInstancesPrepareDraw(cam, pools[i].instances, pools[i].POOL_CAPACITY, lightDat);
     }
     performanceEnd(perfModelProcessing);
 
     // qsort(screenTriangles, screenTriangleCount, sizeof screenTriangles[0], triangleDepthCmp);
-    if (screenTriangleCount == 0) {
+    rasterSetClip(0, 0, g_canvasWidth, g_canvasHeight);
+    const bool tiled = hiddenSurfaceMode == HSR_TILED && g_mode == DCNT_MODE5;
+    if (screenTriangleCount == 0 && !tiled) { // (The tiles have to be cleared even if there's nothing to draw.)
         goto skipOT;
     }
-    int trisToDraw = screenTriangleCount;
-    for (int i = OT_SIZE - 1; i >= 0 && trisToDraw; --i) { // Draw triangles from back to front by iterating over the ordering-table. 
-        for (RasterTriangle *t = orderingTable[i]; t != NULL; t = t->next) {
-            --trisToDraw;
-           if (t->shading == SHADING_FLAT || t->shading == SHADING_FLAT_LIGHTING) {
-                drawTriangleFlatByggmastar(t);
-            } else {
-                drawTriangleWireframe(t);
-            }
-       }
+    if (g_mode == DCNT_MODE4) { // (The span-buffer and the tiles only support the mode 5 canvas.)
+        drawOrderingTablePaintersM4();
+    } else if (hiddenSurfaceMode == HSR_SBUFFER) {
+        drawOrderingTableSbuffer();
+    } else if (tiled) {
+        drawMarkDirty(0, 0, g_canvasWidth, g_canvasHeight); // Every pixel of the canvas is written.
+        if (!drawOrderingTableTiled()) { // Too many triangles to bin, so we do it the regular way. 
+            m5ScaledFill(tileClearColor);
+            drawOrderingTablePainters();
+        }
+    } else {
+        drawOrderingTablePainters();
     }
     skipOT:;
+    drawLines();
 
     performanceEnd(perfTotal);
     
     #ifdef DEBUG_PRINT
     char dbg[64];
-    snprintf(dbg, sizeof(dbg),  "tris: %d", screenTriangleCount);
-    m5_puts(8, 24, dbg, CLR_FUCHSIA);
+    snprintf(dbg, sizeof(dbg),  "tris: %d lines: %d", screenTriangleCount, screenLineCount);
+    drawMarkDirty(8, 24, 8 + 8 * strlen(dbg), 24 + 8);
+    if (g_mode == DCNT_MODE4) {
+        m4_puts(8, 24, dbg, M4_PAL_GREY(31));
+    } else {
+        m5_puts(8, 24, dbg, CLR_FUCHSIA);
+    }
     #endif
 }
 
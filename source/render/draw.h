@@ -6,21 +6,80 @@
 #include "../model.h"
 #include "../raster_geometry.h"
 
+/*
+    How we resolve the visibility of overlapping polygons:
+    - HSR_PAINTERS draws the ordering table from back to front (simple, but every covered pixel is overwritten by each polygon in front of it).
+    - HSR_SBUFFER draws the ordering table from front to back into a span-buffer (cf. sbuffer.h), which writes each pixel at most once. 
+      Worth it for scenes with a lot of overdraw (where the rasterisation dominates the frame time). 
+    - HSR_TILED is the painter's algorithm as well, but it rasterises tile by tile into a buffer in IWRAM, which is copied to VRAM with DMA (cf. tilebuffer.h). 
+      As the tiles are cleared to the colour set by drawSetTileClearColor (black by default) first, it draws the whole canvas, i.e. scenes don't have to clear it 
+      (but anything drawn before drawModelInstancePools is overwritten, and it should only be called once per frame).
+    The mode is reset to HSR_PAINTERS by videoM5ScaledInit/videoM4Init, so scenes which want another one set it in their start and resume functions.
+    (The span-buffer and the tiles are only implemented for the mode 5 canvas; in mode 4, we always use HSR_PAINTERS.)
+*/
+typedef enum DrawHiddenSurfaceMode {
+    HSR_PAINTERS, 
+    HSR_SBUFFER,
+    HSR_TILED
+} DrawHiddenSurfaceMode;
+
 void drawInit(void);
+void drawSetHiddenSurfaceMode(DrawHiddenSurfaceMode mode);
+void drawSetTileClearColor(COLOR clr);
+/*
+    Quality knobs (used by the quality governor, cf. governor.h): drawSetShadingDowngrade draws every instance the given number of steps down the shading ladder 
+    (Gouraud -> flat lighting -> flat -> wireframe; textured counts as flat), drawSetPointStride makes drawPoints only draw every n-th point. 
+    Both are reset by videoM5ScaledInit/videoM4Init. 
+*/
+void drawSetShadingDowngrade(int steps);
+void drawSetPointStride(int stride);
 void resetDispScale(void);
 
 // Mode 5 utils
 void videoM5ScaledInit(void);
+/* 
+    Sets the render resolution of the mode 5 canvas (at most M5_SCALED_W x M5_SCALED_H, even width), e.g. 160x100 (the default), 120x80 or 80x50: 
+    The canvas is scaled up to the width of the screen by the affine background (with letterboxes if it's wider than 3:2), and the cameras adapt their projection 
+    in drawBefore, so heavy scenes can trade resolution for frame rate. It's reset by videoM5ScaledInit, so scenes set it in their start and resume functions. 
+*/
+void drawSetResolution(int width, int height);
 void setDispScaleM5Scaled(void);
 void m5ScaledFill(COLOR clr);
 
-// Mode 4 utils
+/*
+    Dirty rectangles: We keep track of the bounding rectangle of everything drawModelInstancePools and drawPoints draw on each of the two pages. 
+    As a page still holds what we've drawn on it two frames ago, scenes with a static background only have to restore that rectangle (drawDirtyRect) 
+    instead of filling the whole canvas every frame: With m5ScaledClearDirty for a plain colour (which replaces m5ScaledFill), or by redrawing their background within the rectangle. 
+    drawDirtyRect is valid after drawBefore; the whole canvas is dirty after videoM5ScaledInit/videoM4Init (as we don't know what's on the pages then).
+    Anything drawn by other means (e.g. text) has to be marked with drawMarkDirty to be restored.
+*/
+typedef struct DrawRect {
+    int left, top, right, bottom; // In pixels; right and bottom are exclusive. 
+} DrawRect;
+
+DrawRect drawDirtyRect(void);
+void drawMarkDirty(int left, int top, int right, int bottom);
+void m5ScaledClearDirty(COLOR clr);
+
+/*
+    Mode 4 utils
+    Our 3d pipeline draws into mode 4 at the full 240x160 resolution, too. As the pixels are palette indices, it needs the palette loaded by setM4Pal3d: 
+    A ramp of 32 grey levels for the lighting (SHADING_FLAT_LIGHTING and SHADING_GOURAUD), and a 6x6x6 colour cube which the face colours are mapped to (SHADING_FLAT and SHADING_WIREFRAME). 
+    Textured faces are drawn flat in mode 4. The indices from M4_PAL_FREE on are left for the scenes.
+*/
+#define M4_PAL_GREY(level) (level) // level: 0 to 31
+#define M4_PAL_CUBE 32
+#define M4_PAL_CUBE_LEVELS 6
+#define M4_PAL_FREE (M4_PAL_CUBE + M4_PAL_CUBE_LEVELS * M4_PAL_CUBE_LEVELS * M4_PAL_CUBE_LEVELS)
+
 void videoM4Init(void); 
 void setM4Pal(COLOR *pal, int n);
+void setM4Pal3d(void);
 
 /* drawBefore is assumed to be called every frame before the other draw functions are invoked. */
 void drawBefore(Camera *cam);
 void drawModelInstancePools(ModelInstancePool *pools, int numPools, Camera *cam, ModelDrawLightingData lightDat); 
 void drawPoints(const Camera *cam, Vec3 *points, int num, COLOR clr);
+void drawPrintCullingStats(void);
 
 #endif
\ No newline at end of file
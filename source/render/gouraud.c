@@ -0,0 +1,66 @@
+#include <tonc.h>
+
+#include "gouraud.h"
+#include "../commondefs.h"
+
+#define GOURAUD_GREY(intensity) (((u32)(intensity) >> 16) * RGB15(1, 1, 1)) // RGB15(i, i, i) with a single multiplication.
+#define GOURAUD_INDEX(intensity) ((u32)(intensity) >> 16) // The grey ramp of our mode 4 palette starts at index 0 (cf. M4_PAL_GREY in draw.h).
+
+/* 
+    The inner loop of our Gouraud shader, cf. rasteriser.h. Like texmapSpan, it runs in IWRAM in ARM mode, as it's executed for every single shaded pixel.
+    The intensities at the pixel centres of a span are within the range of the vertex intensities in theory, but the gradients of thin slivers can be
+    so steep that the rounding errors push them out of 0 to 31 (which would bleed into the other colour channels), so we clamp those (rare) spans. 
+*/
+IWRAM_CODE_ARM void gouraudSpan(u16 *dst, int len, FIXED_16 intensity, FIXED_16 didx) 
+{
+    const FIXED_16 last = intensity + (len - 1) * didx;
+    if (intensity < 0 || intensity >= (32 << 16) || last < 0 || last >= (32 << 16)) {
+        for (; len > 0; --len) {
+            *dst++ = GOURAUD_GREY(MIN(MAX(intensity, 0), (32 << 16) - 1));
+            intensity += didx;
+        }
+        return;
+    }
+    // Unrolled by two (cf. texmapSpan).
+    for (; len >= 2; len -= 2) {
+        dst[0] = GOURAUD_GREY(intensity);
+        intensity += didx;
+        dst[1] = GOURAUD_GREY(intensity);
+        intensity += didx;
+        dst += 2;
+    }
+    if (len) {
+        dst[0] = GOURAUD_GREY(intensity);
+    }
+}
+
+/* Mode 4 (cf. gouraudSpan): The odd pixels at the ends are read-modify-written, the rest is written in pairs. */
+IWRAM_CODE_ARM void gouraudSpan8(u16 *line, int x, int len, FIXED_16 intensity, FIXED_16 didx) 
+{
+    const FIXED_16 last = intensity + (len - 1) * didx;
+    if (intensity < 0 || intensity >= (32 << 16) || last < 0 || last >= (32 << 16)) {
+        for (; len > 0; --len, ++x) {
+            const u32 idx = GOURAUD_INDEX(MIN(MAX(intensity, 0), (32 << 16) - 1));
+            u16 *dst = line + (x >> 1);
+            *dst = (x & 1) ? ((*dst & 0xff) | (idx << 8)) : ((*dst & 0xff00) | idx);
+            intensity += didx;
+        }
+        return;
+    }
+    u16 *dst = line + (x >> 1);
+    if (x & 1) {
+        *dst = (*dst & 0xff) | (GOURAUD_INDEX(intensity) << 8);
+        ++dst;
+        intensity += didx;
+        --len;
+    }
+    for (; len >= 2; len -= 2) {
+        const u32 lo = GOURAUD_INDEX(intensity);
+        intensity += didx;
+        *dst++ = lo | (GOURAUD_INDEX(intensity) << 8);
+        intensity += didx;
+    }
+    if (len > 0) {
+        *dst = (*dst & 0xff00) | GOURAUD_INDEX(intensity);
+    }
+}
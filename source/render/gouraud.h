@@ -0,0 +1,18 @@
+#ifndef GOURAUD_H
+#define GOURAUD_H
+
+#include <tonc.h>
+#include "texmap.h"
+
+/* 
+    Fills len pixels starting at dst with grey levels, starting at intensity (.16 fixed point, 0 to 31) and stepped by didx for each pixel (Gouraud shading). 
+*/
+void gouraudSpan(u16 *dst, int len, FIXED_16 intensity, FIXED_16 didx);
+
+/* 
+    The same for mode 4: Fills len pixels of the (8bpp) scanline line starting at pixel x with the palette indices of the grey ramp (cf. setM4Pal3d in draw.h), 
+    two pixels per halfword. 
+*/
+void gouraudSpan8(u16 *line, int x, int len, FIXED_16 intensity, FIXED_16 didx);
+
+#endif
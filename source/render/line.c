@@ -0,0 +1,57 @@
+#include <tonc.h>
+
+#include "line.h"
+#include "../commondefs.h"
+
+/* 
+    cf. https://en.wikipedia.org/wiki/Bresenham%27s_line_algorithm (last retrieved 2021-07-09)
+    We step the index of the pixel instead of calculating it for every pixel; err is the (scaled) distance of the next pixel to the ideal line. 
+    For mode 4 (paletted), VRAM can't be written bytewise, so every pixel is read-modify-written (as the constant is folded, there's no branch per pixel for the mode). 
+*/
+INLINE void lineBresenham(int x1, int y1, int x2, int y2, COLOR clr, int pitch, bool paletted) 
+{
+    int dx = x2 - x1, dy = y2 - y1;
+    int xstep = 1, ystep = pitch;
+    if (dx < 0) {
+        dx = -dx;
+        xstep = -1;
+    }
+    if (dy < 0) {
+        dy = -dy;
+        ystep = -pitch;
+    }
+    int major = dx, minor = dy, majorStep = xstep, minorStep = ystep;
+    if (dy > dx) { // y-major.
+        major = dy;
+        minor = dx;
+        majorStep = ystep;
+        minorStep = xstep;
+    }
+    u16 *page = (u16*)vid_page;
+    int pos = y1 * pitch + x1;
+    int err = 2 * minor - major;
+    for (int i = major; i >= 0; --i) {
+        if (paletted) {
+            u16 *dst = page + (pos >> 1);
+            *dst = (pos & 1) ? ((*dst & 0xff) | (clr << 8)) : ((*dst & 0xff00) | clr);
+        } else {
+            page[pos] = clr;
+        }
+        if (err > 0) {
+            pos += minorStep;
+            err -= 2 * major;
+        }
+        pos += majorStep;
+        err += 2 * minor;
+    }
+}
+
+IWRAM_CODE_ARM void m5_line_bresenham(int x1, int y1, int x2, int y2, COLOR clr) 
+{
+    lineBresenham(x1, y1, x2, y2, clr, M5_WIDTH, false);
+}
+
+IWRAM_CODE_ARM void m4_line_bresenham(int x1, int y1, int x2, int y2, COLOR clrIdx) 
+{
+    lineBresenham(x1, y1, x2, y2, clrIdx, M4_WIDTH, true);
+}
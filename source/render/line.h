@@ -0,0 +1,16 @@
+#ifndef LINE_H
+#define LINE_H
+
+#include <tonc.h>
+
+/* 
+    Draws a line from (x1, y1) to (x2, y2) (both inclusive) into the current mode 5 page with Bresenham's algorithm (in IWRAM, ARM). 
+    The end points have to be on the canvas (cf. g_canvasWidth/g_canvasHeight), i.e. the line has to be clipped already (cf. clipLineCohenSutherland). 
+    Faster than m5_line (libtonc), which is generic over the pitch and runs from ROM. 
+*/
+void m5_line_bresenham(int x1, int y1, int x2, int y2, COLOR clr);
+
+/* The same for mode 4 (clrIdx is a palette index). */
+void m4_line_bresenham(int x1, int y1, int x2, int y2, COLOR clrIdx);
+
+#endif
@@ -4,70 +4,178 @@
 #include <tonc.h>
 #include "../globals.h"
 #include "../raster_geometry.h"
+#include "texmap.h"
+#include "gouraud.h"
+#include "sbuffer.h"
+#include "tilebuffer.h"
+#include "spanfill.h"
+#include "slopelut.h"
+#include "clipping.h"
 
 /*  
     Credits of the triangle rasterisation code: Mats Byggmastar (a.k.a. MRI / Doomsday)
     who described it in their article "Fast affine texture mapping (fatmap.txt)".
     I adapted it to draw flat polygons. 
-    The parts of triangles outside of the screen are simply not drawn; this code was added by me, 
+    The vertices are in subpixel precision (cf. raster_geometry.h), and the edges are prestepped to the pixel centres of their first scanline (cf. fatmap2.txt by the same author). 
+    The parts of triangles outside of the screen are simply not drawn (cf. the guard band below); this code was added by me, 
     and is not described anywhere in fatmap.txt; therefore, it might be less correct. 
     cf. http://ftp.lanet.lv/ftp/mirror/x2ftp/msdos/programming/theory/fatmap.txt (last retrieved 2021-05-14)
 */
  
 #define FIXED_16_2_INT_CEIL(n) ((n + 0xffff) >> 16)
-typedef int FIXED_16;
-static const RasterPoint* left_array[3];
-static const RasterPoint* right_array[3];
+static const RasterPoint* left_array[RASTER_MAX_VERTS];
+static const RasterPoint* right_array[RASTER_MAX_VERTS];
 static int left_section_idx, right_section_idx;
 static int left_section_height, right_section_height;
 static FIXED_16 left_x, delta_left_x, right_x, delta_right_x; // Those are in .16 fixed point as opposed to our default .8 (Better accuracy).
 
+/* 
+    The rectangle the rasterisers clip to (in pixels; right and bottom are exclusive): The canvas, or the current tile for HSR_TILED (cf. tilebuffer.h). 
+    Has to be set with rasterSetClip before anything is rasterised. 
+*/
+static int raster_clip_left, raster_clip_top, raster_clip_right, raster_clip_bottom;
+
+INLINE void rasterSetClip(int left, int top, int right, int bottom) 
+{
+    raster_clip_left = left;
+    raster_clip_top = top;
+    raster_clip_right = right;
+    raster_clip_bottom = bottom;
+}
+
+/*
+    Guard band: Before a triangle is rasterised, we look at its bounding box (cf. rasterGuardBand).
+    - Most triangles lie horizontally within the clip rectangle, so their spans are filled as they are, without clamping them on every scanline. 
+    - Triangles which stick out of the canvas by at most RASTER_GUARD_BAND pixels have their spans clamped (that's cheaper than clipping them, as long as the parts outside are small).
+    - Triangles which reach beyond the guard band (typically huge ones close to the camera) are clipped to the canvas once (cf. clipTriangleVerts2d), 
+      and the resulting convex polygon is rasterised as a fan of triangles which don't need any clamping either (unless we're drawing a tile). 
+    (Vertically, the sections are clipped once per section anyway, so that's not a per-scanline cost.)
+*/
+#define RASTER_GUARD_BAND 48
+static bool raster_scissor; // Whether the spans of the current triangle have to be clamped to the clip rectangle.
+
+typedef struct RasterFan {
+    bool clipped; // If not, the triangle itself is rasterised.
+    ClipVertex2d verts[CLIPPING_MAX_POLY_LEN];
+    RasterTriangle tri;
+} RasterFan;
+
+/* Classifies the triangle (its first numVerts vertices) for the guard band, and returns the number of triangles to rasterise (cf. rasterFanTriangle). */
+INLINE int rasterGuardBand(const RasterTriangle *tri, int numVerts, RasterFan *fan) 
+{
+    int minX = tri->vert[0].x, maxX = minX, minY = tri->vert[0].y, maxY = minY;
+    for (int i = 1; i < numVerts; ++i) {
+        minX = MIN(minX, tri->vert[i].x);
+        maxX = MAX(maxX, tri->vert[i].x);
+        minY = MIN(minY, tri->vert[i].y);
+        maxY = MAX(maxY, tri->vert[i].y);
+    }
+    // The pixel centres of the clip rectangle widened by half a pixel: With the fill convention (cf. calcRightSection), no span of a triangle within those bounds can leave the rectangle.
+    const int left = (raster_clip_left << RASTER_SUBPIXEL_BITS) - RASTER_SUBPIXEL_ONE / 2, right = ((raster_clip_right - 1) << RASTER_SUBPIXEL_BITS) + RASTER_SUBPIXEL_ONE / 2;
+    fan->clipped = false;
+    if (minX >= left && maxX <= right) {
+        raster_scissor = false;
+        return 1;
+    }
+    /* 
+        The guard band is around the canvas (not the clip rectangle), and we clip to the canvas as well: That way, each triangle is clipped exactly the same way 
+        for every tile of HSR_TILED (which then clamps the spans of the fan to the tile), and the tiles look exactly like the whole canvas drawn at once. 
+    */
+    const int canvasLeft = -RASTER_SUBPIXEL_ONE / 2, canvasRight = ((g_canvasWidth - 1) << RASTER_SUBPIXEL_BITS) + RASTER_SUBPIXEL_ONE / 2;
+    const int canvasTop = -RASTER_SUBPIXEL_ONE / 2, canvasBottom = ((g_canvasHeight - 1) << RASTER_SUBPIXEL_BITS) + RASTER_SUBPIXEL_ONE / 2;
+    const int guard = RASTER_GUARD_BAND << RASTER_SUBPIXEL_BITS;
+    raster_scissor = true;
+    if (minX >= canvasLeft - guard && maxX <= canvasRight + guard && minY >= canvasTop - guard && maxY <= canvasBottom + guard) {
+        return 1;
+    }
+    raster_scissor = raster_clip_left > 0 || raster_clip_top > 0 || raster_clip_right < g_canvasWidth || raster_clip_bottom < g_canvasHeight; // Only for tiles.
+    fan->clipped = true;
+    fan->tri = *tri;
+    fan->tri.numVerts = 3;
+    const int n = clipTriangleVerts2d(tri, numVerts, canvasLeft, canvasTop, canvasRight, canvasBottom, fan->verts);
+    return n ? n - 2 : 0;
+}
+
+/* The i-th triangle to rasterise: The triangle itself, or the i-th triangle of the fan (0, i + 1, i + 2) of its clipped polygon. */
+INLINE const RasterTriangle *rasterFanTriangle(const RasterTriangle *tri, RasterFan *fan, int i) 
+{
+    if (!fan->clipped) {
+        return tri;
+    }
+    for (int j = 0; j < 3; ++j) {
+        const ClipVertex2d *vert = fan->verts + (j ? i + j : 0);
+        fan->tri.vert[j] = vert->pos;
+        fan->tri.texCoord[j] = vert->texCoord;
+        fan->tri.intensity[j] = vert->intensity;
+    }
+    return &fan->tri;
+}
+
+/* 
+    Returns (num << shift) / denom. Edges (or texture coordinate deltas) which are long enough to overflow with a 32-bit shift are rare (they only occur for 
+    huge off-screen triangles), so we only pay for the 64-bit division in those cases. 
+    denom has to be positive (which it always is, as the vertices are sorted by y). Edges which fit on the canvas use the reciprocal LUT instead of the division (cf. slopelut.h).
+*/
+INLINE FIXED_16 rasterSlope(int num, int denom, int shift) 
+{
+    if (num >= -(1 << (30 - shift)) && num < (1 << (30 - shift))) {
+#ifdef RASTER_SLOPE_LUT
+        if (denom < SLOPE_LUT_SIZE) {
+            return slopeLutDivide(num << shift, denom);
+        }
+#endif
+        return (num << shift) / denom;
+    }
+    return (FIXED_16)(((s64)num << shift) / denom);
+}
+
+/* 
+    The sections are rasterised with the top-left fill convention: Scanline y belongs to the edge from v1 to v2 if v1->y <= y < v2->y (at pixel centres),  
+    which means neighbouring triangles never draw a scanline twice (and don't leave gaps). Analogously, a span covers the pixels from ceil(left_x) to ceil(right_x) - 1.
+    Returns the number of scanlines in the section (which can be zero or negative if there are none on the screen).
+*/
 INLINE int calcRightSection(void) {
     const RasterPoint *v1 = right_array[right_section_idx];
     const RasterPoint *v2 = right_array[right_section_idx - 1];
-    int height = v2->y - v1->y;
-    if (height == 0) {
+    const int yStart = MAX(raster_clip_top, RASTER_SUBPIXEL_CEIL(v1->y)); // Vertical "clipping".
+    const int yEnd = MIN(raster_clip_bottom, RASTER_SUBPIXEL_CEIL(v2->y));
+    if (yEnd <= yStart) { // No scanline centre within the section (this also saves the division for flat sections).
         return 0;
     }
-    delta_right_x = ((v2->x - v1->x) << 16) / height;
-
-    right_x = (v1->x << 16);
-    int dy = MAX(0, v1->y) - v1->y; // Vertical "clipping".
-    if (dy) {
-        right_x += dy * delta_right_x;
-    }
-    return right_section_height = MIN(M5_SCALED_H, v2->y) - MAX(0, v1->y);
+    delta_right_x = rasterSlope(v2->x - v1->x, v2->y - v1->y, 16);
+    // Prestep from the vertex to the centre of the first scanline (dy is in .4).
+    const int dy = (yStart << RASTER_SUBPIXEL_BITS) - v1->y;
+    right_x = (v1->x << (16 - RASTER_SUBPIXEL_BITS)) + (FIXED_16)(((s64)dy * delta_right_x) >> RASTER_SUBPIXEL_BITS);
+    return right_section_height = yEnd - yStart;
 }
 
 INLINE int calcLeftSection(void) {
     const RasterPoint *v1 = left_array[left_section_idx];
     const RasterPoint *v2 = left_array[left_section_idx - 1];
-
-    int height = v2->y - v1->y;
-    if (height == 0) {
+    const int yStart = MAX(raster_clip_top, RASTER_SUBPIXEL_CEIL(v1->y)); // Vertical "clipping".
+    const int yEnd = MIN(raster_clip_bottom, RASTER_SUBPIXEL_CEIL(v2->y));
+    if (yEnd <= yStart) {
         return 0;
     }
-    delta_left_x = ((v2->x - v1->x) << 16) / height;
-    left_x = (v1->x << 16);
-    int dy = MAX(0, v1->y) - v1->y; // Vertical "clipping".
-    if (dy) {
-        left_x += dy * delta_left_x;
-    }
-    return left_section_height = MIN(M5_SCALED_H, v2->y) - MAX(0, v1->y);
+    delta_left_x = rasterSlope(v2->x - v1->x, v2->y - v1->y, 16);
+    const int dy = (yStart << RASTER_SUBPIXEL_BITS) - v1->y;
+    left_x = (v1->x << (16 - RASTER_SUBPIXEL_BITS)) + (FIXED_16)(((s64)dy * delta_left_x) >> RASTER_SUBPIXEL_BITS);
+    return left_section_height = yEnd - yStart;
 }
 
-/* 
-    A version of m5_hline (libtonc) which does not normalise x1 and x2, i.e. just assumes x1 < x2. 
-    It is measurably faster because it's called so often, and we can guarantee x1 < x2 (If I'm not wrong).
-    Dangerous: If the invariant is not met, it will lead to crashes or bugs, so don't use this if you're unsure. 
-*/
-INLINE void m5_hline_nonorm(int x1, int y, int x2, COLOR clr) 
+/* The tile buffer versions of the span functions (for HSR_TILED, cf. tilebuffer.h); the rasterisers have to be clipped to the current tile. */
+INLINE void tile_hline_nonorm(int x1, int y, int x2, COLOR clr) 
 {
-    u16 *dstL= (u16*)((u8*)vid_page+y*(M5_WIDTH<<1) + x1*2);
-    memset16(dstL, clr, x2-x1+1);
+    spanFill16(tileBufferPixel(x1, y), clr, x2 - x1 + 1);
 }
 
-INLINE void drawTriangleFlatByggmastar(const RasterTriangle *tri) 
+/* 
+    The function which fills the (already clipped) horizontal spans of a triangle, e.g. m5_hline_nonorm, m4_hline_nonorm, tile_hline_nonorm or sbufferSpan. 
+    As rasteriseTriangleFlat is inlined, passing a constant here results in a direct call (and no indirect call per scanline).
+*/
+typedef void (*RasterSpanFunc)(int x1, int y, int x2, COLOR clr);
+
+INLINE void rasteriseTriangleFlatSpans(const RasterTriangle *tri, RasterSpanFunc spanFunc) 
 {
     const RasterPoint *v1 = tri->vert;
     const RasterPoint *v2 = tri->vert + 1;
@@ -84,7 +192,7 @@ INLINE void drawTriangleFlatByggmastar(const RasterTriangle *tri)
         const RasterPoint *tmp = v2; v2 = v3; v3 = tmp;
     }
 
-    if (v1->y >= M5_SCALED_H - 1) { // Triangle certainly invisible. 
+    if (RASTER_SUBPIXEL_CEIL(v1->y) >= raster_clip_bottom) { // Triangle certainly invisible. 
         return;
     }
 
@@ -106,7 +214,7 @@ INLINE void drawTriangleFlatByggmastar(const RasterTriangle *tri)
     const int dy1 = v2->y - v1->y;
     const int dx2 = v3->x - v1->x;
     const int dy2 = v3->y - v1->y;
-    const int cross = dx1 * dy2 - dy1 * dx2;
+    const s64 cross = (s64)dx1 * dy2 - (s64)dy1 * dx2; // (The subpixel coordinates of off-screen vertices can overflow 32 bits here.)
 
     if (cross > 0) { // Middle vertex is on the right side
         right_array[0] = v3;
@@ -148,12 +256,14 @@ INLINE void drawTriangleFlatByggmastar(const RasterTriangle *tri)
             }
         }
     }
-    int y = MAX(0, v1->y);
+    int y = MAX(raster_clip_top, RASTER_SUBPIXEL_CEIL(v1->y));
     while (1) {
         const int x1 = FIXED_16_2_INT_CEIL(left_x);
         const int x2 = FIXED_16_2_INT_CEIL(right_x) - 1;
-        if (!(x1 < 0 &&  x2 < 0) && !(x1 >= M5_SCALED_W && x2 >= M5_SCALED_W)) { // Horizontal "clipping": Don't draw if *both* x-positions are either to the left, or both are to the right of the screen.
-            m5_hline_nonorm(MAX(0, x1), y, MIN(M5_SCALED_W - 1, x2), tri->color);
+        if (!raster_scissor) { // Within the clip rectangle (cf. rasterGuardBand).
+            spanFunc(x1, y, x2, tri->color);
+        } else if (!(x1 < raster_clip_left && x2 < raster_clip_left) && !(x1 >= raster_clip_right && x2 >= raster_clip_right)) { // Horizontal "clipping": Don't draw if *both* x-positions are either to the left, or both are to the right of the clipping rectangle.
+            spanFunc(MAX(raster_clip_left, x1), y, MIN(raster_clip_right - 1, x2), tri->color);
         }
       
         if (--left_section_height <= 0) { // Check if we've reached the bottom of the left section. 
@@ -176,4 +286,505 @@ INLINE void drawTriangleFlatByggmastar(const RasterTriangle *tri)
     }
 }
 
-#endif
\ No newline at end of file
+INLINE void rasteriseTriangleFlat(const RasterTriangle *tri, RasterSpanFunc spanFunc) 
+{
+    RasterFan fan;
+    const int count = rasterGuardBand(tri, 3, &fan);
+    for (int i = 0; i < count; ++i) {
+        rasteriseTriangleFlatSpans(rasterFanTriangle(tri, &fan, i), spanFunc);
+    }
+}
+
+INLINE void drawTriangleFlatByggmastar(const RasterTriangle *tri) 
+{
+    rasteriseTriangleFlat(tri, m5_hline_nonorm);
+}
+
+
+/* 
+    Convex polygons (i.e. our quads) are rasterised the same way as triangles, in a single pass: 
+    The left and right chains of edges between the top and the bottom vertex are just longer, and every chain can have several sections 
+    (of which the ones in the middle can be empty, e.g. for horizontal edges, so we have to skip those instead of stopping).
+*/
+
+/* 
+    Fills array with the chain of vertices from the top to the bottom vertex (walking through the vertices with the given step), 
+    ordered from the bottom to the top as in rasteriseTriangleFlat. Returns the section index of the topmost section.
+*/
+INLINE int polygonChain(const RasterTriangle *poly, int top, int bottom, int step, const RasterPoint **array) 
+{
+    const RasterPoint *chain[RASTER_MAX_VERTS];
+    int len = 0;
+    for (int i = top; ; i += step) {
+        if (i >= poly->numVerts) {
+            i -= poly->numVerts;
+        }
+        chain[len++] = poly->vert + i;
+        if (i == bottom) {
+            break;
+        }
+    }
+    for (int i = 0; i < len; ++i) {
+        array[i] = chain[len - 1 - i];
+    }
+    return len - 1;
+}
+
+/* Advance to the next section of the chain which has any scanlines on the screen; returns false if there is none left. */
+INLINE bool findLeftSection(void) 
+{
+    while (calcLeftSection() <= 0) {
+        if (--left_section_idx <= 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+INLINE bool findRightSection(void) 
+{
+    while (calcRightSection() <= 0) {
+        if (--right_section_idx <= 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+INLINE void rasterisePolygonFlatSpans(const RasterTriangle *poly, RasterSpanFunc spanFunc) 
+{
+    const int n = poly->numVerts;
+    const RasterPoint *vert = poly->vert;
+    int top = 0, bottom = 0;
+    s64 area = 0; // Twice the signed area; positive if the vertices are in clockwise order on the screen.
+    for (int i = 0; i < n; ++i) {
+        const RasterPoint *next = vert + (i + 1 < n ? i + 1 : 0);
+        if (vert[i].y < vert[top].y) {
+            top = i;
+        }
+        if (vert[i].y > vert[bottom].y) {
+            bottom = i;
+        }
+        area += (s64)vert[i].x * next->y - (s64)next->x * vert[i].y;
+    }
+    if (area == 0 || RASTER_SUBPIXEL_CEIL(vert[top].y) >= raster_clip_bottom) { // Degenerate, or certainly invisible.
+        return;
+    }
+    // For clockwise polygons, the chain of increasing indices is the right one (cf. the cross product in rasteriseTriangleFlat).
+    const int rightStep = area > 0 ? 1 : n - 1;
+    right_section_idx = polygonChain(poly, top, bottom, rightStep, right_array);
+    left_section_idx = polygonChain(poly, top, bottom, n - rightStep, left_array);
+    if (!findLeftSection() || !findRightSection()) {
+        return;
+    }
+
+    int y = MAX(raster_clip_top, RASTER_SUBPIXEL_CEIL(vert[top].y));
+    while (1) {
+        const int x1 = FIXED_16_2_INT_CEIL(left_x);
+        const int x2 = FIXED_16_2_INT_CEIL(right_x) - 1;
+        if (!raster_scissor) { 
+            spanFunc(x1, y, x2, poly->color);
+        } else if (!(x1 < raster_clip_left && x2 < raster_clip_left) && !(x1 >= raster_clip_right && x2 >= raster_clip_right)) { 
+            spanFunc(MAX(raster_clip_left, x1), y, MIN(raster_clip_right - 1, x2), poly->color);
+        }
+      
+        if (--left_section_height <= 0) { 
+            if (--left_section_idx <= 0 || !findLeftSection())
+                return;
+        } else { 
+            left_x += delta_left_x;
+        }
+        if (--right_section_height <= 0) { 
+            if (--right_section_idx <= 0 || !findRightSection())
+                return;
+        } else { 
+            right_x += delta_right_x;
+        }
+        ++y;
+    }
+}
+
+/* (The fan of a clipped polygon is rasterised with rasterisePolygonFlatSpans as well, which handles triangles just fine.) */
+INLINE void rasterisePolygonFlat(const RasterTriangle *poly, RasterSpanFunc spanFunc) 
+{
+    RasterFan fan;
+    const int count = rasterGuardBand(poly, poly->numVerts, &fan);
+    for (int i = 0; i < count; ++i) {
+        rasterisePolygonFlatSpans(rasterFanTriangle(poly, &fan, i), spanFunc);
+    }
+}
+
+/* 
+    Affine texture mapping as described in fatmap.txt: We interpolate u and v along the left edges of the triangle, 
+    and as u and v are linear functions of x and y in an affine mapper, du/dx and dv/dx are constant for the whole triangle.  
+    (We calculate them from the longest scanline, which is why we need the commented-out "longest scanline" code above after all.)
+*/
+static const TexCoord* left_tex_array[3];
+static FIXED_16 left_u, delta_left_u, left_v, delta_left_v; // In .16 fixed point texel units.
+static FIXED_16 tex_dudx, tex_dvdx;
+static const Texture *tex_texture;
+
+/* Fills the pixels x1 to x2 (inclusive) of scanline y; u and v are the texture coordinates at x1. */
+typedef void (*RasterTexSpanFunc)(int x1, int y, int x2, FIXED_16 u, FIXED_16 v);
+
+INLINE int calcLeftSectionTextured(void) 
+{
+    const RasterPoint *v1 = left_array[left_section_idx];
+    const RasterPoint *v2 = left_array[left_section_idx - 1];
+    const TexCoord *t1 = left_tex_array[left_section_idx];
+    const TexCoord *t2 = left_tex_array[left_section_idx - 1];
+    const int yStart = MAX(raster_clip_top, RASTER_SUBPIXEL_CEIL(v1->y));
+    if (MIN(raster_clip_bottom, RASTER_SUBPIXEL_CEIL(v2->y)) <= yStart) {
+        return 0;
+    }
+    // The texture coordinates are in .8 texel units and y in .4, hence the shift by 12 for .16 deltas per scanline.
+    const int height = v2->y - v1->y;
+    delta_left_u = rasterSlope(t2->u - t1->u, height, 16 - 8 + RASTER_SUBPIXEL_BITS);
+    delta_left_v = rasterSlope(t2->v - t1->v, height, 16 - 8 + RASTER_SUBPIXEL_BITS);
+    const int dy = (yStart << RASTER_SUBPIXEL_BITS) - v1->y; // Prestep to the centre of the first scanline.
+    left_u = (t1->u << 8) + (FIXED_16)(((s64)dy * delta_left_u) >> RASTER_SUBPIXEL_BITS);
+    left_v = (t1->v << 8) + (FIXED_16)(((s64)dy * delta_left_v) >> RASTER_SUBPIXEL_BITS);
+    return calcLeftSection();
+}
+
+INLINE void m5_texspan(int x1, int y, int x2, FIXED_16 u, FIXED_16 v) 
+{
+    if (x1 > x2) {
+        return;
+    }
+    u16 *dst = (u16*)((u8*)vid_page + y * (M5_WIDTH << 1) + x1 * 2);
+    texmapSpan(dst, x2 - x1 + 1, u, v, tex_dudx, tex_dvdx, tex_texture);
+}
+
+INLINE void tile_texspan(int x1, int y, int x2, FIXED_16 u, FIXED_16 v) 
+{
+    if (x1 > x2) {
+        return;
+    }
+    texmapSpan(tileBufferPixel(x1, y), x2 - x1 + 1, u, v, tex_dudx, tex_dvdx, tex_texture);
+}
+
+/* Like m5_texspan, but only fills the parts of the span which the span-buffer (cf. sbuffer.h) considers uncovered. */
+INLINE void m5_texspan_sbuffer(int x1, int y, int x2, FIXED_16 u, FIXED_16 v) 
+{
+    u8 gapStart[SBUFFER_MAX_SPANS_PER_LINE + 1], gapEnd[SBUFFER_MAX_SPANS_PER_LINE + 1];
+    const int gaps = sbufferCoverSpan(x1, y, x2, gapStart, gapEnd);
+    u16 *line = (u16*)((u8*)vid_page + y * (M5_WIDTH << 1));
+    for (int i = 0; i < gaps; ++i) {
+        const int offset = gapStart[i] - x1;
+        texmapSpan(line + gapStart[i], gapEnd[i] - gapStart[i] + 1, u + offset * tex_dudx, v + offset * tex_dvdx, tex_dudx, tex_dvdx, tex_texture);
+    }
+}
+
+INLINE void rasteriseTriangleTexturedSpans(const RasterTriangle *tri, RasterTexSpanFunc spanFunc) 
+{
+    int i1 = 0, i2 = 1, i3 = 2;
+    // Sort vertices: v1 should be the top, v2 the middle, and v3 the bottom vertex (we sort indices, as the texture coordinates have to be sorted as well). 
+    if (tri->vert[i1].y > tri->vert[i2].y) {
+        int tmp = i1; i1 = i2; i2 = tmp;
+    }
+    if (tri->vert[i1].y > tri->vert[i3].y) {
+        int tmp = i1; i1 = i3; i3 = tmp;
+    }
+    if (tri->vert[i2].y > tri->vert[i3].y) {
+        int tmp = i2; i2 = i3; i3 = tmp;
+    }
+    const RasterPoint *v1 = tri->vert + i1, *v2 = tri->vert + i2, *v3 = tri->vert + i3;
+    const TexCoord *t1 = tri->texCoord + i1, *t2 = tri->texCoord + i2, *t3 = tri->texCoord + i3;
+
+    if (RASTER_SUBPIXEL_CEIL(v1->y) >= raster_clip_bottom) { // Triangle certainly invisible. 
+        return;
+    }
+    const int height = v3->y - v1->y;
+    if (height == 0) { // Degenerate triangle.
+        return;
+    }
+
+    // Calculate the length of the longest scanline (at the height of the middle vertex), and the constant u/v gradients from it. 
+    const FIXED_16 alpha = rasterSlope(v2->y - v1->y, height, 16);
+    // In .20 (.16 times the .4 subpixel coordinates); signed: negative if the middle vertex is on the right.
+    const s64 longest = (s64)alpha * (v3->x - v1->x) + ((s64)(v1->x - v2->x) << 16); 
+    if (longest > -(1 << (16 + RASTER_SUBPIXEL_BITS)) && longest < (1 << (16 + RASTER_SUBPIXEL_BITS))) { // Less than one pixel wide, the gradients don't matter.
+        tex_dudx = 0;
+        tex_dvdx = 0;
+    } else {
+        const FIXED_16 inv = (1 << 24) / (int)(longest >> (8 + RASTER_SUBPIXEL_BITS)); // 1 / longest in .16
+        const FIXED_16 uLong = (t1->u << 8) + (FIXED_16)(((s64)alpha * (t3->u - t1->u)) >> 8);
+        const FIXED_16 vLong = (t1->v << 8) + (FIXED_16)(((s64)alpha * (t3->v - t1->v)) >> 8);
+        tex_dudx = (FIXED_16)(((s64)(uLong - (t2->u << 8)) * inv) >> 16);
+        tex_dvdx = (FIXED_16)(((s64)(vLong - (t2->v << 8)) * inv) >> 16);
+    }
+    tex_texture = tri->texture;
+
+    if (longest < 0) { // Middle vertex is on the right side
+        right_array[0] = v3;
+        right_array[1] = v2;
+        right_array[2] = v1;
+        right_section_idx = 2;
+        left_array[0] = v3;
+        left_array[1] = v1;
+        left_tex_array[0] = t3;
+        left_tex_array[1] = t1;
+        left_section_idx = 1;
+
+        if (calcLeftSectionTextured() <= 0) { 
+            return;
+        }
+        if (calcRightSection() <= 0) {
+            right_section_idx--;
+            if (calcRightSection() <= 0) { 
+                return;
+            }
+        }
+    } else { // Middle vertex is on the left side
+        left_array[0] = v3;
+        left_array[1] = v2;
+        left_array[2] = v1;
+        left_tex_array[0] = t3;
+        left_tex_array[1] = t2;
+        left_tex_array[2] = t1;
+        left_section_idx = 2;
+        right_array[0] = v3;
+        right_array[1] = v1;
+        right_section_idx = 1;
+
+        if (calcRightSection() <= 0) { 
+            return;
+        }
+        if (calcLeftSectionTextured() <= 0) {
+            left_section_idx--;
+            if (calcLeftSectionTextured() <= 0) { 
+                return;
+            }
+        }
+    }
+    int y = MAX(raster_clip_top, RASTER_SUBPIXEL_CEIL(v1->y));
+    while (1) {
+        const int x1 = FIXED_16_2_INT_CEIL(left_x);
+        const int x2 = FIXED_16_2_INT_CEIL(right_x) - 1;
+        if (!raster_scissor) {
+            // Prestep the texture coordinates from the left edge to the center of the first pixel.
+            const FIXED_16 prestep = (x1 << 16) - left_x;
+            spanFunc(x1, y, x2, left_u + (FIXED_16)(((s64)prestep * tex_dudx) >> 16), left_v + (FIXED_16)(((s64)prestep * tex_dvdx) >> 16));
+        } else if (!(x1 < raster_clip_left && x2 < raster_clip_left) && !(x1 >= raster_clip_right && x2 >= raster_clip_right)) { 
+            // The same, but we also skip the clamped pixels.
+            const FIXED_16 prestep = (MAX(raster_clip_left, x1) << 16) - left_x;
+            const FIXED_16 u = left_u + (FIXED_16)(((s64)prestep * tex_dudx) >> 16);
+            const FIXED_16 v = left_v + (FIXED_16)(((s64)prestep * tex_dvdx) >> 16);
+            spanFunc(MAX(raster_clip_left, x1), y, MIN(raster_clip_right - 1, x2), u, v);
+        }
+      
+        if (--left_section_height <= 0) { 
+            if (--left_section_idx <= 0)
+                return;
+            if (calcLeftSectionTextured() <= 0)
+                return;
+        } else { 
+            left_x += delta_left_x;
+            left_u += delta_left_u;
+            left_v += delta_left_v;
+        }
+        if (--right_section_height <= 0) { 
+            if (--right_section_idx <= 0)
+                return;
+            if (calcRightSection() <= 0)
+                return;
+        } else { 
+            right_x += delta_right_x;
+        }
+        ++y;
+    }
+}
+
+INLINE void rasteriseTriangleTextured(const RasterTriangle *tri, RasterTexSpanFunc spanFunc) 
+{
+    RasterFan fan;
+    const int count = rasterGuardBand(tri, 3, &fan);
+    for (int i = 0; i < count; ++i) {
+        rasteriseTriangleTexturedSpans(rasterFanTriangle(tri, &fan, i), spanFunc);
+    }
+}
+
+/* 
+    Gouraud shading works just like the texture mapping above, but with a single interpolated value (the intensity) instead of u and v.
+*/
+static const FIXED* left_intensity_array[3];
+static FIXED_16 left_intensity, delta_left_intensity; // In .16 fixed point grey levels.
+static FIXED_16 gouraud_didx;
+
+/* Fills the pixels x1 to x2 (inclusive) of scanline y; intensity is the one at x1. */
+typedef void (*RasterGouraudSpanFunc)(int x1, int y, int x2, FIXED_16 intensity);
+
+INLINE int calcLeftSectionGouraud(void) 
+{
+    const RasterPoint *v1 = left_array[left_section_idx];
+    const RasterPoint *v2 = left_array[left_section_idx - 1];
+    const FIXED i1 = *left_intensity_array[left_section_idx];
+    const FIXED i2 = *left_intensity_array[left_section_idx - 1];
+    const int yStart = MAX(raster_clip_top, RASTER_SUBPIXEL_CEIL(v1->y));
+    if (MIN(raster_clip_bottom, RASTER_SUBPIXEL_CEIL(v2->y)) <= yStart) {
+        return 0;
+    }
+    delta_left_intensity = rasterSlope(i2 - i1, v2->y - v1->y, 16 - 8 + RASTER_SUBPIXEL_BITS); // cf. calcLeftSectionTextured
+    const int dy = (yStart << RASTER_SUBPIXEL_BITS) - v1->y;
+    left_intensity = (i1 << 8) + (FIXED_16)(((s64)dy * delta_left_intensity) >> RASTER_SUBPIXEL_BITS);
+    return calcLeftSection();
+}
+
+INLINE void m5_gouraudspan(int x1, int y, int x2, FIXED_16 intensity) 
+{
+    if (x1 > x2) {
+        return;
+    }
+    u16 *dst = (u16*)((u8*)vid_page + y * (M5_WIDTH << 1) + x1 * 2);
+    gouraudSpan(dst, x2 - x1 + 1, intensity, gouraud_didx);
+}
+
+INLINE void tile_gouraudspan(int x1, int y, int x2, FIXED_16 intensity) 
+{
+    if (x1 > x2) {
+        return;
+    }
+    gouraudSpan(tileBufferPixel(x1, y), x2 - x1 + 1, intensity, gouraud_didx);
+}
+
+/* The mode 4 version of m5_gouraudspan (with the grey ramp of our mode 4 palette, cf. setM4Pal3d). */
+INLINE void m4_gouraudspan(int x1, int y, int x2, FIXED_16 intensity) 
+{
+    if (x1 > x2) {
+        return;
+    }
+    gouraudSpan8((u16*)((u8*)vid_page + y * M4_WIDTH), x1, x2 - x1 + 1, intensity, gouraud_didx);
+}
+
+/* Like m5_gouraudspan, but only fills the parts of the span which the span-buffer (cf. sbuffer.h) considers uncovered. */
+INLINE void m5_gouraudspan_sbuffer(int x1, int y, int x2, FIXED_16 intensity) 
+{
+    u8 gapStart[SBUFFER_MAX_SPANS_PER_LINE + 1], gapEnd[SBUFFER_MAX_SPANS_PER_LINE + 1];
+    const int gaps = sbufferCoverSpan(x1, y, x2, gapStart, gapEnd);
+    u16 *line = (u16*)((u8*)vid_page + y * (M5_WIDTH << 1));
+    for (int i = 0; i < gaps; ++i) {
+        gouraudSpan(line + gapStart[i], gapEnd[i] - gapStart[i] + 1, intensity + (gapStart[i] - x1) * gouraud_didx, gouraud_didx);
+    }
+}
+
+INLINE void rasteriseTriangleGouraudSpans(const RasterTriangle *tri, RasterGouraudSpanFunc spanFunc) 
+{
+    int i1 = 0, i2 = 1, i3 = 2;
+    // Sort vertices (indices, as the intensities have to be sorted as well), cf. rasteriseTriangleTextured.
+    if (tri->vert[i1].y > tri->vert[i2].y) {
+        int tmp = i1; i1 = i2; i2 = tmp;
+    }
+    if (tri->vert[i1].y > tri->vert[i3].y) {
+        int tmp = i1; i1 = i3; i3 = tmp;
+    }
+    if (tri->vert[i2].y > tri->vert[i3].y) {
+        int tmp = i2; i2 = i3; i3 = tmp;
+    }
+    const RasterPoint *v1 = tri->vert + i1, *v2 = tri->vert + i2, *v3 = tri->vert + i3;
+    const FIXED *c1 = tri->intensity + i1, *c2 = tri->intensity + i2, *c3 = tri->intensity + i3;
+
+    if (RASTER_SUBPIXEL_CEIL(v1->y) >= raster_clip_bottom) { // Triangle certainly invisible. 
+        return;
+    }
+    const int height = v3->y - v1->y;
+    if (height == 0) { // Degenerate triangle.
+        return;
+    }
+
+    // The constant intensity gradient from the longest scanline, cf. rasteriseTriangleTextured.
+    const FIXED_16 alpha = rasterSlope(v2->y - v1->y, height, 16);
+    const s64 longest = (s64)alpha * (v3->x - v1->x) + ((s64)(v1->x - v2->x) << 16); 
+    if (longest > -(1 << (16 + RASTER_SUBPIXEL_BITS)) && longest < (1 << (16 + RASTER_SUBPIXEL_BITS))) { 
+        gouraud_didx = 0;
+    } else {
+        const FIXED_16 inv = (1 << 24) / (int)(longest >> (8 + RASTER_SUBPIXEL_BITS)); 
+        const FIXED_16 iLong = (*c1 << 8) + (FIXED_16)(((s64)alpha * (*c3 - *c1)) >> 8);
+        gouraud_didx = (FIXED_16)(((s64)(iLong - (*c2 << 8)) * inv) >> 16);
+    }
+
+    if (longest < 0) { // Middle vertex is on the right side
+        right_array[0] = v3;
+        right_array[1] = v2;
+        right_array[2] = v1;
+        right_section_idx = 2;
+        left_array[0] = v3;
+        left_array[1] = v1;
+        left_intensity_array[0] = c3;
+        left_intensity_array[1] = c1;
+        left_section_idx = 1;
+
+        if (calcLeftSectionGouraud() <= 0) { 
+            return;
+        }
+        if (calcRightSection() <= 0) {
+            right_section_idx--;
+            if (calcRightSection() <= 0) { 
+                return;
+            }
+        }
+    } else { // Middle vertex is on the left side
+        left_array[0] = v3;
+        left_array[1] = v2;
+        left_array[2] = v1;
+        left_intensity_array[0] = c3;
+        left_intensity_array[1] = c2;
+        left_intensity_array[2] = c1;
+        left_section_idx = 2;
+        right_array[0] = v3;
+        right_array[1] = v1;
+        right_section_idx = 1;
+
+        if (calcRightSection() <= 0) { 
+            return;
+        }
+        if (calcLeftSectionGouraud() <= 0) {
+            left_section_idx--;
+            if (calcLeftSectionGouraud() <= 0) { 
+                return;
+            }
+        }
+    }
+    int y = MAX(raster_clip_top, RASTER_SUBPIXEL_CEIL(v1->y));
+    while (1) {
+        const int x1 = FIXED_16_2_INT_CEIL(left_x);
+        const int x2 = FIXED_16_2_INT_CEIL(right_x) - 1;
+        if (!raster_scissor) {
+            const FIXED_16 prestep = (x1 << 16) - left_x; // cf. rasteriseTriangleTexturedSpans
+            spanFunc(x1, y, x2, left_intensity + (FIXED_16)(((s64)prestep * gouraud_didx) >> 16));
+        } else if (!(x1 < raster_clip_left && x2 < raster_clip_left) && !(x1 >= raster_clip_right && x2 >= raster_clip_right)) { 
+            const FIXED_16 prestep = (MAX(raster_clip_left, x1) << 16) - left_x;
+            spanFunc(MAX(raster_clip_left, x1), y, MIN(raster_clip_right - 1, x2), left_intensity + (FIXED_16)(((s64)prestep * gouraud_didx) >> 16));
+        }
+      
+        if (--left_section_height <= 0) { 
+            if (--left_section_idx <= 0)
+                return;
+            if (calcLeftSectionGouraud() <= 0)
+                return;
+        } else { 
+            left_x += delta_left_x;
+            left_intensity += delta_left_intensity;
+        }
+        if (--right_section_height <= 0) { 
+            if (--right_section_idx <= 0)
+                return;
+            if (calcRightSection() <= 0)
+                return;
+        } else { 
+            right_x += delta_right_x;
+        }
+        ++y;
+    }
+}
+
+INLINE void rasteriseTriangleGouraud(const RasterTriangle *tri, RasterGouraudSpanFunc spanFunc) 
+{
+    RasterFan fan;
+    const int count = rasterGuardBand(tri, 3, &fan);
+    for (int i = 0; i < count; ++i) {
+        rasteriseTriangleGouraudSpans(rasterFanTriangle(tri, &fan, i), spanFunc);
+    }
+}
+
+#endif
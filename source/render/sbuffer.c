@@ -0,0 +1,125 @@
+#include <tonc.h>
+
+#include "sbuffer.h"
+#include "spanfill.h"
+#include "../globals.h"
+#include "../commondefs.h"
+
+/* 
+    The spans of each scanline are sorted by x and never touch each other (touching or overlapping spans are merged on insertion).
+    Start and end are inclusive; u8 is enough as our canvas is at most M5_SCALED_W pixels wide. 
+    Those arrays live in IWRAM (about 5 KiB), as they are accessed for every single span we rasterise. 
+*/
+static u8 spanStart[M5_SCALED_H][SBUFFER_MAX_SPANS_PER_LINE];
+static u8 spanEnd[M5_SCALED_H][SBUFFER_MAX_SPANS_PER_LINE];
+static u8 spanCount[M5_SCALED_H];
+static int linesFull; // Number of scanlines which are completely covered (so we can stop drawing altogether once the whole canvas is covered). 
+static int overflows; // Number of spans which couldn't be recorded since the last sbufferTakeOverflows (cf. sbufferCoverSpan).
+
+IWRAM_CODE_ARM void sbufferReset(void) 
+{
+    for (int y = 0; y < g_canvasHeight; ++y) {
+        spanCount[y] = 0;
+    }
+    linesFull = 0;
+}
+
+IWRAM_CODE_ARM bool sbufferFull(void) 
+{
+    return linesFull >= g_canvasHeight;
+}
+
+int sbufferTakeOverflows(void) 
+{
+    const int n = overflows;
+    overflows = 0;
+    return n;
+}
+
+INLINE void sbufferFill(int x1, int y, int x2, COLOR clr) 
+{
+    u16 *dst = (u16*)((u8*)vid_page + y * (M5_WIDTH << 1) + x1 * 2);
+    spanFill16(dst, clr, x2 - x1 + 1);
+}
+
+/* 
+    Marks the span from x1 to x2 (inclusive) as covered, and writes the parts of it which were not covered before into gapStart/gapEnd (inclusive).
+    Returns the number of those gaps (at most SBUFFER_MAX_SPANS_PER_LINE + 1), which are the only parts of the span the caller has to fill. 
+    Invariant: Has to be called front to back, and with 0 <= x1, x2 < g_canvasWidth. 
+*/
+IWRAM_CODE_ARM int sbufferCoverSpan(int x1, int y, int x2, u8 *gapStart, u8 *gapEnd) 
+{
+    if (x1 > x2) {
+        return 0;
+    }
+    u8 *start = spanStart[y];
+    u8 *end = spanEnd[y];
+    const int count = spanCount[y];
+    if (count == 1 && start[0] == 0 && end[0] == g_canvasWidth - 1) { // Scanline completely covered already.
+        return 0;
+    }
+
+    int i = 0;
+    while (i < count && end[i] + 1 < x1) { // Skip the spans which are completely to the left (and don't touch our span).
+        ++i;
+    }
+    const int first = i;
+    int mergedStart = x1, mergedEnd = x2;
+    int uncovered = x1; // The leftmost pixel of our span which might not be covered yet.
+    int gaps = 0;
+    while (i < count && start[i] <= x2 + 1) { // Collect the gaps between the spans which overlap/touch our span.
+        if (start[i] > uncovered) {
+            gapStart[gaps] = uncovered;
+            gapEnd[gaps++] = start[i] - 1;
+        }
+        uncovered = MAX(uncovered, end[i] + 1);
+        mergedStart = MIN(mergedStart, start[i]);
+        mergedEnd = MAX(mergedEnd, end[i]);
+        ++i;
+    }
+    if (uncovered <= x2) {
+        gapStart[gaps] = uncovered;
+        gapEnd[gaps++] = x2;
+    }
+
+    // Replace the spans first to i - 1 (which we merged) with the merged span.
+    const int merged = i - first;
+    if (merged == 0) { 
+        if (count == SBUFFER_MAX_SPANS_PER_LINE) {
+            /* 
+                The scanline is too fragmented, so we can't remember our span. Spans drawn later on this scanline (which are farther away) might overwrite it then.
+                (It would need more than SBUFFER_MAX_SPANS_PER_LINE visible gaps on a single scanline; we count those cases, cf. drawPrintCullingStats.)
+            */
+            ++overflows;
+            return gaps;
+        }
+        for (int j = count; j > first; --j) {
+            start[j] = start[j - 1];
+            end[j] = end[j - 1];
+        }
+        spanCount[y] = count + 1;
+    } else if (merged > 1) {
+        for (int j = first + 1; j + merged - 1 < count; ++j) {
+            start[j] = start[j + merged - 1];
+            end[j] = end[j + merged - 1];
+        }
+        spanCount[y] = count - merged + 1;
+    }
+    start[first] = mergedStart;
+    end[first] = mergedEnd;
+
+    if (mergedStart == 0 && mergedEnd == g_canvasWidth - 1) { // The scanline just became completely covered (already covered ones return early).
+        ++linesFull;
+    }
+    return gaps;
+}
+
+/* Fills the parts of the span from x1 to x2 (inclusive) which are not covered by any span drawn before, and marks the whole span as covered. */
+IWRAM_CODE_ARM void sbufferSpan(int x1, int y, int x2, COLOR clr) 
+{
+    u8 gapStart[SBUFFER_MAX_SPANS_PER_LINE + 1], gapEnd[SBUFFER_MAX_SPANS_PER_LINE + 1];
+    const int gaps = sbufferCoverSpan(x1, y, x2, gapStart, gapEnd);
+    for (int i = 0; i < gaps; ++i) {
+        sbufferFill(gapStart[i], y, gapEnd[i], clr);
+    }
+}
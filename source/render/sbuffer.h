@@ -0,0 +1,25 @@
+#ifndef SBUFFER_H
+#define SBUFFER_H
+
+#include <tonc.h>
+#include "../commondefs.h"
+
+/*
+    Span-buffer (s-buffer) for hidden surface removal without overdraw.
+    For each scanline, we keep a sorted list of the horizontal spans which have already been filled this frame.
+    If we draw our polygons from front to back (by iterating over the ordering table in reverse), every new span only has to fill the parts of the scanline
+    which are not covered yet, which means each pixel of the canvas is written at most once per frame.
+    cf. Paul Nettle's "s-Buffer FAQ", although we don't need to store any depth values in our spans thanks to the ordering table.
+*/
+
+// Spans which touch or overlap are merged, so this limit is only reached for scanlines which are very fragmented.
+#define SBUFFER_MAX_SPANS_PER_LINE 24
+
+void sbufferReset(void);
+int sbufferCoverSpan(int x1, int y, int x2, u8 *gapStart, u8 *gapEnd);
+void sbufferSpan(int x1, int y, int x2, COLOR clr);
+bool sbufferFull(void);
+// The number of spans which were drawn but couldn't be recorded because their scanline already had SBUFFER_MAX_SPANS_PER_LINE spans, since the last call.
+int sbufferTakeOverflows(void);
+
+#endif
@@ -0,0 +1,48 @@
+#include <tonc.h>
+
+#include "slopelut.h"
+#include "../globals.h"
+#include "../logutils.h"
+
+EWRAM_DATA u32 slopeLut[SLOPE_LUT_SIZE];
+
+void slopeLutInit(void) 
+{
+    slopeLut[0] = 0;
+    for (int d = 1; d < SLOPE_LUT_SIZE; ++d) {
+        slopeLut[d] = (u32)((((u64)1 << SLOPE_LUT_SHIFT) + d - 1) / d);
+    }
+}
+
+#ifdef SLOPE_LUT_CHECK
+
+static void slopeLutCheckQuotient(int num, int denom) 
+{
+    if (slopeLutDivide(num, denom) != num / denom) {
+        mgba_printf("slopeLutCheck: %d / %d: lut %d, division %d", num, denom, slopeLutDivide(num, denom), num / denom);
+        panic("slopeLutCheck: mismatch");
+    }
+}
+
+/* 
+    Checks the numerators which are most likely to go wrong, i.e. the multiples of denom (and their neighbours) up to the maximum of 2^30, 
+    as well as the ones the rasteriser actually produces for the x coordinates (dx << 16 for every dx on the canvas). 
+    Takes a few seconds on hardware, which is why it's only compiled in on demand (cf. globals.h). 
+*/
+void slopeLutCheck(void) 
+{
+    for (int denom = 1; denom < SLOPE_LUT_SIZE; ++denom) {
+        for (int m = (1 << 30) / denom - 1; m > 0; m -= m / 8 + 1) {
+            for (int k = -1; k <= 1; ++k) {
+                slopeLutCheckQuotient(m * denom + k, denom);
+                slopeLutCheckQuotient(-(m * denom + k), denom);
+            }
+        }
+        for (int dx = -(M5_SCALED_W << RASTER_SUBPIXEL_BITS); dx <= (M5_SCALED_W << RASTER_SUBPIXEL_BITS); dx += 7) {
+            slopeLutCheckQuotient(dx << 16, denom);
+        }
+    }
+    mgba_printf("slopeLutCheck: OK");
+}
+
+#endif
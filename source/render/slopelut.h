@@ -0,0 +1,49 @@
+#ifndef SLOPELUT_H
+#define SLOPELUT_H
+
+#include <tonc.h>
+#include "../commondefs.h"
+#include "../raster_geometry.h"
+
+/*
+    Reciprocal LUT for the edge slopes of the rasteriser: Instead of dividing by the height of each edge section, we multiply by its reciprocal.
+    As our vertices are in subpixel precision (cf. raster_geometry.h), the table is indexed by the height of the edge in subpixels, 
+    i.e. it covers all edges up to the height of the mode 5 canvas; taller edges (which can only belong to triangles which are partly off-screen, or to the 160 lines tall mode 4 canvas) 
+    still use the division. (We don't size the table for mode 4 to save memory.)
+    The results are exactly the same as the ones of the division (cf. slopeLutDivide), so disabling the LUT doesn't change a single pixel.
+*/
+#define RASTER_SLOPE_LUT // Comment out to use the division for every edge.
+
+#define SLOPE_LUT_SIZE ((M5_SCALED_H << RASTER_SUBPIXEL_BITS) + 1)
+#define SLOPE_LUT_SHIFT 31
+
+/* 
+    slopeLut[d] = ceil(2^31 / d) (index 0 is unused). In EWRAM, as it's about 6.4 KiB, which IWRAM (shared with the stack, our IWRAM code and buffers, and the AAS mixer) can't spare: 
+    It's only read a few times per edge section (not per scanline or pixel), so the waitstates of those loads don't matter compared to the division it saves. 
+*/
+extern u32 slopeLut[SLOPE_LUT_SIZE];
+
+/* Fills the table; has to be called before anything is rasterised. */
+void slopeLutInit(void);
+
+/* 
+    Returns num / denom (rounded towards zero, like the C division) for 0 < denom < SLOPE_LUT_SIZE and |num| < 2^30. 
+    With r = ceil(2^31 / d), the estimate (|num| * r) >> 31 is either the exact quotient or one too large (the error is below |num| / 2^31 < 1/2), 
+    so one multiplication suffices to correct it. 
+*/
+INLINE int slopeLutDivide(int num, int denom) 
+{
+    const u32 absNum = ABS(num);
+    u32 q = (u32)(((u64)absNum * slopeLut[denom]) >> SLOPE_LUT_SHIFT);
+    if (q * denom > absNum) {
+        --q;
+    }
+    return num < 0 ? -(int)q : (int)q;
+}
+
+#ifdef SLOPE_LUT_CHECK
+/* Compares slopeLutDivide with the division for every denominator of the table (and lots of numerators) and panics on the first mismatch. */
+void slopeLutCheck(void);
+#endif
+
+#endif
@@ -0,0 +1,47 @@
+#include <tonc.h>
+
+#include "spanfill.h"
+#include "../globals.h"
+#include "../logutils.h"
+
+#ifdef SPANFILL_BENCHMARK
+
+#define SPANFILL_BENCHMARK_ITERATIONS 32 // Few enough that the longest spans don't overflow the 16-bit cycle counter.
+
+typedef void (*SpanFillFunc)(u16 *dst, u32 clr, int count);
+
+static void memset16Wrapper(u16 *dst, u32 clr, int count) 
+{
+    memset16(dst, clr, count);
+}
+
+/* Average cycles per span (with the destination being halfword- and word-aligned half of the time each, like our spans). */
+static int spanFillCycles(SpanFillFunc fill, int len) 
+{
+    u16 *dst = (u16*)vid_page;
+    REG_TM2CNT = 0;
+    REG_TM2D = 0;
+    REG_TM2CNT = TM_ENABLE | TM_FREQ_1;
+    const u16 start = REG_TM2D;
+    for (int i = 0; i < SPANFILL_BENCHMARK_ITERATIONS; ++i) {
+        fill(dst + (i & 1), CLR_WHITE, len);
+    }
+    const u16 end = REG_TM2D;
+    REG_TM2CNT = 0;
+    return (u16)(end - start) / SPANFILL_BENCHMARK_ITERATIONS;
+}
+
+void spanFillBenchmark(void) 
+{
+    static const int lengths[] = {1, 2, 3, 4, 8, 12, 16, 24, 32, 48, 64, 96, 128, 160};
+    const u16 ime = REG_IME;
+    REG_IME = 0; // No interrupts (audio) while measuring.
+    const int overhead = spanFillCycles(spanFill16, 0); // The loop and call overhead (spanFill16 returns immediately for empty spans).
+    for (int i = 0; i < (int)(sizeof(lengths) / sizeof(lengths[0])); ++i) {
+        const int len = lengths[i];
+        mgba_printf("spanfill: %d px: spanFill16 %d cycles, memset16 %d cycles", len, spanFillCycles(spanFill16, len) - overhead, spanFillCycles(memset16Wrapper, len) - overhead);
+    }
+    REG_IME = ime;
+}
+
+#endif
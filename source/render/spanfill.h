@@ -0,0 +1,50 @@
+#ifndef SPANFILL_H
+#define SPANFILL_H
+
+#include <tonc.h>
+
+/* 
+    Fills count pixels starting at dst (which has to be halfword-aligned) with clr (asm/spanfill16.s, in IWRAM). 
+    A replacement for memset16 which is faster for the short spans our triangles consist of. 
+*/
+void spanFill16(u16 *dst, u32 clr, int count);
+
+/* 
+    A version of m5_hline (libtonc) which does not normalise x1 and x2, i.e. just assumes x1 < x2. 
+    It is measurably faster because it's called so often, and we can guarantee x1 < x2 (If I'm not wrong).
+    Dangerous: If the invariant is not met, it will lead to crashes or bugs, so don't use this if you're unsure. 
+    (We use spanFill16 instead of memset16, which has less overhead for the short spans of our triangles, cf. spanfill.h)
+*/
+INLINE void m5_hline_nonorm(int x1, int y, int x2, COLOR clr) 
+{
+    u16 *dstL= (u16*)((u8*)vid_page+y*(M5_WIDTH<<1) + x1*2);
+    spanFill16(dstL, clr, x2-x1+1);
+}
+
+/* 
+    The mode 4 version of m5_hline_nonorm (clr is a palette index): VRAM can't be written bytewise, so the odd pixels at the ends of the span 
+    are read-modify-written, and the rest is filled two pixels per halfword (which halves the writes per pixel compared to mode 5).
+*/
+INLINE void m4_hline_nonorm(int x1, int y, int x2, COLOR clr) 
+{
+    if (x1 > x2) {
+        return;
+    }
+    u16 *line = (u16*)((u8*)vid_page + y * M4_WIDTH);
+    if (x1 & 1) { // The first pixel is the high byte of its halfword.
+        line[x1 >> 1] = (line[x1 >> 1] & 0xff) | (clr << 8);
+        ++x1;
+    }
+    if (!(x2 & 1) && x2 >= x1) { // The last pixel is the low byte of its halfword.
+        line[x2 >> 1] = (line[x2 >> 1] & 0xff00) | clr;
+        --x2;
+    }
+    spanFill16(line + (x1 >> 1), clr | (clr << 8), (x2 - x1 + 1) >> 1);
+}
+
+#ifdef SPANFILL_BENCHMARK
+/* Prints the cycles per span of spanFill16 and memset16 for different span lengths with mgba_printf. Has to be called before timerInit (it uses timer 2). */
+void spanFillBenchmark(void);
+#endif
+
+#endif
@@ -0,0 +1,31 @@
+#include <tonc.h>
+
+#include "texmap.h"
+#include "../commondefs.h"
+
+/* 
+    The inner loop of our affine texture mapper, cf. fatmap.txt (Mats Byggmastar) and rasteriser.h. 
+    It runs in IWRAM in ARM mode, as it's executed for every single textured pixel. 
+    We wrap the texture coordinates with masks (the texture dimensions are powers of two), so texture coordinates outside of [0, 1] repeat the texture. 
+*/
+IWRAM_CODE_ARM void texmapSpan(u16 *dst, int len, FIXED_16 u, FIXED_16 v, FIXED_16 dudx, FIXED_16 dvdx, const Texture *texture) 
+{
+    const COLOR *texels = texture->texels;
+    const int widthLog2 = texture->widthLog2;
+    const u32 uMask = (1 << widthLog2) - 1;
+    const u32 vMask = (1 << texture->heightLog2) - 1;
+
+    // Unrolled by two (the loop overhead is significant compared to the few instructions per texel). 
+    for (; len >= 2; len -= 2) {
+        dst[0] = texels[((((u32)v >> 16) & vMask) << widthLog2) + (((u32)u >> 16) & uMask)];
+        u += dudx;
+        v += dvdx;
+        dst[1] = texels[((((u32)v >> 16) & vMask) << widthLog2) + (((u32)u >> 16) & uMask)];
+        u += dudx;
+        v += dvdx;
+        dst += 2;
+    }
+    if (len) {
+        dst[0] = texels[((((u32)v >> 16) & vMask) << widthLog2) + (((u32)u >> 16) & uMask)];
+    }
+}
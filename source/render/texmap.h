@@ -0,0 +1,15 @@
+#ifndef TEXMAP_H
+#define TEXMAP_H
+
+#include <tonc.h>
+#include "../raster_geometry.h"
+
+typedef int FIXED_16;
+
+/* 
+    Fills len pixels starting at dst with texels of the given texture. 
+    u and v are the texture coordinates (.16 fixed point texel units) of the first pixel, and are stepped by dudx and dvdx for each pixel (affine texture mapping). 
+*/
+void texmapSpan(u16 *dst, int len, FIXED_16 u, FIXED_16 v, FIXED_16 dudx, FIXED_16 dvdx, const Texture *texture);
+
+#endif
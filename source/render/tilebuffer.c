@@ -0,0 +1,114 @@
+#include <tonc.h>
+
+#include "tilebuffer.h"
+#include "../globals.h"
+#include "../commondefs.h"
+
+// In IWRAM (.bss), as every pixel we rasterise is written to it. 
+COLOR tileBuffer[TILE_H * TILE_W] ALIGN4;
+int tileBufferLeft, tileBufferTop, tileBufferWidth, tileBufferHeight;
+
+/*
+    The bins are singly linked lists of the triangles overlapping each tile; their entries share one pool (binTri/binNext),
+    as the number of tiles a triangle overlaps varies a lot.
+*/
+EWRAM_DATA static RasterTriangle *binTri[TILE_BIN_MAX_ENTRIES];
+EWRAM_DATA static s16 binNext[TILE_BIN_MAX_ENTRIES];
+static s16 binHead[TILES_Y(M5_SCALED_H)][TILES_X(M5_SCALED_W)], binTail[TILES_Y(M5_SCALED_H)][TILES_X(M5_SCALED_W)];
+static int binEntryCount;
+
+IWRAM_CODE_ARM void tileBinReset(void)
+{
+    for (int y = 0; y < TILES_Y(g_canvasHeight); ++y) {
+        for (int x = 0; x < TILES_X(g_canvasWidth); ++x) {
+            binHead[y][x] = -1;
+        }
+    }
+    binEntryCount = 0;
+}
+
+/* Adds the triangle to the bins of all tiles its bounding box overlaps; returns false if we ran out of entries. */
+IWRAM_CODE_ARM bool tileBinAdd(RasterTriangle *tri)
+{
+    int minX = tri->vert[0].x, maxX = minX, minY = tri->vert[0].y, maxY = minY;
+    for (int i = 1; i < tri->numVerts; ++i) {
+        minX = MIN(minX, tri->vert[i].x);
+        maxX = MAX(maxX, tri->vert[i].x);
+        minY = MIN(minY, tri->vert[i].y);
+        maxY = MAX(maxY, tri->vert[i].y);
+    }
+    // The pixels whose centres can lie within the triangle (cf. raster_geometry.h), clamped to the canvas.
+    const int left = MAX(0, RASTER_SUBPIXEL_CEIL(minX)), right = MIN(g_canvasWidth - 1, maxX >> RASTER_SUBPIXEL_BITS);
+    const int top = MAX(0, RASTER_SUBPIXEL_CEIL(minY)), bottom = MIN(g_canvasHeight - 1, maxY >> RASTER_SUBPIXEL_BITS);
+    if (left > right || top > bottom) { // Doesn't cover any pixels.
+        return true;
+    }
+    const int tx1 = left / TILE_W, tx2 = right / TILE_W;
+    const int ty1 = top / TILE_H, ty2 = bottom / TILE_H;
+    if (binEntryCount + (tx2 - tx1 + 1) * (ty2 - ty1 + 1) > TILE_BIN_MAX_ENTRIES) {
+        return false;
+    }
+    for (int ty = ty1; ty <= ty2; ++ty) {
+        for (int tx = tx1; tx <= tx2; ++tx) {
+            const int entry = binEntryCount++;
+            binTri[entry] = tri;
+            binNext[entry] = -1;
+            if (binHead[ty][tx] < 0) {
+                binHead[ty][tx] = entry;
+            } else {
+                binNext[binTail[ty][tx]] = entry;
+            }
+            binTail[ty][tx] = entry;
+        }
+    }
+    return true;
+}
+
+IWRAM_CODE_ARM RasterTriangle *tileBinFirst(int tileX, int tileY, int *iter)
+{
+    *iter = binHead[tileY][tileX];
+    return *iter < 0 ? NULL : binTri[*iter];
+}
+
+IWRAM_CODE_ARM RasterTriangle *tileBinNext(int *iter)
+{
+    *iter = binNext[*iter];
+    return *iter < 0 ? NULL : binTri[*iter];
+}
+
+IWRAM_CODE_ARM void tileBufferBegin(int tileX, int tileY, COLOR clearColor)
+{
+    tileBufferLeft = tileX * TILE_W;
+    tileBufferTop = tileY * TILE_H;
+    tileBufferWidth = MIN(TILE_W, g_canvasWidth - tileBufferLeft);
+    tileBufferHeight = MIN(TILE_H, g_canvasHeight - tileBufferTop);
+    memset32(tileBuffer, dup16(clearColor), (TILE_W * TILE_H) / 2);
+}
+
+/* Copies the finished tile to its place on the page. */
+IWRAM_CODE_ARM void tileBufferFlush(void)
+{
+    COLOR *dst = vid_page + tileBufferTop * M5_WIDTH + tileBufferLeft;
+    if (tileBufferWidth == M5_WIDTH) { // The rows of the tile are contiguous on the page as well.
+        dma3_cpy(dst, tileBuffer, tileBufferHeight * M5_WIDTH * sizeof(COLOR));
+        return;
+    }
+    for (int y = 0; y < tileBufferHeight; ++y, dst += M5_WIDTH) {
+        dma3_cpy(dst, tileBuffer + y * TILE_W, tileBufferWidth * sizeof(COLOR));
+    }
+}
+
+/* Tiles without any triangles don't need the buffer, we fill them on the page directly. */
+IWRAM_CODE_ARM void tileFillEmpty(int tileX, int tileY, COLOR clearColor)
+{
+    const int left = tileX * TILE_W, top = tileY * TILE_H;
+    const int width = MIN(TILE_W, g_canvasWidth - left), height = MIN(TILE_H, g_canvasHeight - top);
+    COLOR *dst = vid_page + top * M5_WIDTH + left;
+    if (width == M5_WIDTH) {
+        dma3_fill(dst, dup16(clearColor), height * M5_WIDTH * sizeof(COLOR));
+        return;
+    }
+    for (int y = 0; y < height; ++y, dst += M5_WIDTH) {
+        dma3_fill(dst, dup16(clearColor), width * sizeof(COLOR));
+    }
+}
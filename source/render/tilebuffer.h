@@ -0,0 +1,44 @@
+#ifndef TILEBUFFER_H
+#define TILEBUFFER_H
+
+#include <tonc.h>
+#include "../commondefs.h"
+#include "../raster_geometry.h"
+
+/*
+    Tile-binned rasterisation (HSR_TILED, cf. draw.h): The triangles of the ordering table are sorted into the screen tiles they overlap (binned),
+    and each tile is then rasterised back to front into a buffer in IWRAM (which is written with 32-bit accesses on the fast bus, instead of 16-bit accesses to VRAM),
+    and copied to the page with DMA once it's finished. Every pixel of the canvas is written to VRAM exactly once per frame, no matter the overdraw;
+    tiles without any triangles are just filled with the clear colour.
+    The tiles in the last column/row are cut off if they don't divide the canvas evenly (cf. drawSetResolution). 
+    With TILE_W == M5_SCALED_W, a tile is copied with a single transfer (but the buffer gets quite large).
+*/
+#define TILE_W 32
+#define TILE_H 20
+#define TILES_X(canvasWidth) (((canvasWidth) + TILE_W - 1) / TILE_W)
+#define TILES_Y(canvasHeight) (((canvasHeight) + TILE_H - 1) / TILE_H)
+
+// The total number of triangle references in all bins; if a frame has more, tileBinAdd fails (and we fall back to drawing without tiles).
+#define TILE_BIN_MAX_ENTRIES 2048
+
+// The tile we're currently rasterising into (cf. tileBufferBegin), its top-left pixel on the canvas, and its size (which is smaller than TILE_W x TILE_H if it's cut off).
+extern COLOR tileBuffer[TILE_H * TILE_W];
+extern int tileBufferLeft, tileBufferTop, tileBufferWidth, tileBufferHeight;
+
+void tileBinReset(void);
+bool tileBinAdd(RasterTriangle *tri);
+/* The binned triangles of the tile (in the order they were added) are iterated with tileBinFirst/tileBinNext, which return NULL at the end. */
+RasterTriangle *tileBinFirst(int tileX, int tileY, int *iter);
+RasterTriangle *tileBinNext(int *iter);
+
+void tileBufferBegin(int tileX, int tileY, COLOR clearColor);
+void tileBufferFlush(void);
+void tileFillEmpty(int tileX, int tileY, COLOR clearColor);
+
+/* The address of pixel (x, y) of the canvas in the tile buffer (which has to lie within the current tile). */
+INLINE COLOR *tileBufferPixel(int x, int y)
+{
+    return tileBuffer + (y - tileBufferTop) * TILE_W + (x - tileBufferLeft);
+}
+
+#endif
@@ -0,0 +1,72 @@
+#include <tonc.h>
+
+#include "transformcache.h"
+#include "../logutils.h"
+
+EWRAM_DATA static u32 arena[TRANSFORM_CACHE_ARENA_SIZE / sizeof(u32)];
+static int arenaUsed; // In bytes.
+static int generation = 1; // Entries of older generations are gone (cf. transformCacheReset); instances start out with generation 0.
+
+void transformCacheReset(void) 
+{
+    arenaUsed = 0;
+    ++generation;
+}
+
+int transformCacheBytesUsed(void) 
+{
+    return arenaUsed;
+}
+
+static void *arenaAlloc(int bytes) 
+{
+    bytes = (bytes + 3) & ~3; // Word-aligned.
+    if (arenaUsed + bytes > TRANSFORM_CACHE_ARENA_SIZE) {
+        return NULL;
+    }
+    void *mem = (u8*)arena + arenaUsed;
+    arenaUsed += bytes;
+    return mem;
+}
+
+/* Has to be called once per frame for each instance we draw; sets transformDirty if its transform differs from the one of the last frame. */
+IWRAM_CODE_ARM void transformCacheTrack(ModelInstance *instance) 
+{
+    const bool unchanged = instance->state.pos.x == instance->state.lastPos.x && instance->state.pos.y == instance->state.lastPos.y && instance->state.pos.z == instance->state.lastPos.z 
+                        && instance->state.scale.x == instance->state.lastScale.x && instance->state.scale.y == instance->state.lastScale.y && instance->state.scale.z == instance->state.lastScale.z 
+                        && instance->state.yaw == instance->state.lastYaw && instance->state.pitch == instance->state.lastPitch && instance->state.roll == instance->state.lastRoll;
+    if (unchanged && !instance->state.transformDirty) {
+        return;
+    }
+    if (!unchanged) {
+        instance->state.lastPos = instance->state.pos;
+        instance->state.lastScale = instance->state.scale;
+        instance->state.lastYaw = instance->state.yaw;
+        instance->state.lastPitch = instance->state.pitch;
+        instance->state.lastRoll = instance->state.roll;
+    }
+    // The entry (if any) is outdated either way; we only use it again once the instance has stood still for a frame.
+    instance->state.transformDirty = !unchanged;
+    if (instance->state.cache != NULL && instance->state.cacheGeneration == generation) {
+        instance->state.cache->valid = false;
+    }
+}
+
+/* The entry of an instance which isn't dirty (cf. transformCacheTrack), allocated on the first call; NULL if the instance is dirty, or if the arena is full. */
+IWRAM_CODE_ARM TransformCacheEntry *transformCacheGet(ModelInstance *instance) 
+{
+    if (instance->state.transformDirty) {
+        return NULL;
+    }
+    if (instance->state.cache != NULL && instance->state.cacheGeneration == generation) {
+        return instance->state.cache;
+    }
+    TransformCacheEntry *entry = arenaAlloc(sizeof(TransformCacheEntry));
+    instance->state.cache = entry;
+    if (entry == NULL) {
+        return NULL;
+    }
+    entry->valid = false;
+    instance->state.cacheGeneration = generation;
+    return entry;
+}
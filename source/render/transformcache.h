@@ -0,0 +1,30 @@
+#ifndef TRANSFORMCACHE_H
+#define TRANSFORMCACHE_H
+
+#include <tonc.h>
+#include "../math.h"
+#include "../model.h"
+
+/*
+    Transform cache: Most of our instances never move (e.g. the subway, or the cubes of the testbed), but their rotation matrix (a dozen sines and cosines) 
+    and the world space centre of their bounding sphere would be computed every frame. For instances whose transform (pos, scale, yaw, pitch, roll) 
+    hasn't changed since the last frame, we keep them in an entry of an EWRAM arena instead. 
+    (The vertices themselves aren't cached: They're transformed from model space to camera space with a single matrix (cf. matrix3x4createTransform), 
+    which costs just as much as transforming cached world space vertices would.)
+    Instances which move every frame never get an entry (they don't take up any space), and an instance which starts to move again keeps its entry for later. 
+    The arena is a bump allocator; it's reset (cf. transformCacheReset) when we switch scenes. If it's full, instances just aren't cached. 
+*/
+#define TRANSFORM_CACHE_ARENA_SIZE (4 * 1024) // In bytes.
+
+typedef struct TransformCacheEntry {
+    bool valid; // Whether rotation and boundsCenter have been computed for the current transform.
+    FIXED rotation[16]; // cf. matrix4x4createYawPitchRoll
+    Vec3 boundsCenter; // The centre of the bounding sphere of the instance in world space. 
+} TransformCacheEntry;
+
+void transformCacheReset(void);
+void transformCacheTrack(ModelInstance *instance);
+TransformCacheEntry *transformCacheGet(ModelInstance *instance);
+int transformCacheBytesUsed(void);
+
+#endif
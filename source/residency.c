@@ -0,0 +1,338 @@
+#include <tonc.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "residency.h"
+#include "logutils.h"
+#include "globals.h"
+
+// The parts of a mesh (cf. meshWantedParts).
+#define PART_VERTS 1
+#define PART_FACES 2 // With their vertex indices.
+#define PART_NORMALS 4
+#define PART_EDGES 8
+
+#define ARENA_IWRAM 0
+#define ARENA_EWRAM 1
+#define ARENA_NUM 2
+
+#define IN_ROM(ptr) ((uintptr_t)(ptr) >= MEM_ROM)
+
+typedef struct ResidentMesh {
+    const PackedVec3 *romVerts; // The mesh is identified by its vertices; NULL if the slot is free.
+    const Face *romFaces;
+    const u32 *romFaceIndices;
+    const PackedNormal *romVertNormals;
+    const Edge *romEdges;
+    int numVerts, numFaces, numEdges;
+    int parts; // The parts which are resident, 0 if none.
+    int wantedParts; // The parts the current scene draws, 0 if it doesn't use the mesh.
+    int arena, offset, size; // Where the copies of the resident parts are (one after the other, word-aligned).
+    int lastUsed; // The scene switch (cf. residencyEnter) the mesh has last been drawn in, for the LRU eviction.
+    PackedVec3 *verts; // The copies (cf. meshSetPointers).
+    Face *faces;
+    u32 *faceIndices;
+    PackedNormal *vertNormals;
+    Edge *edges;
+} ResidentMesh;
+
+static u32 iwramArena[RESIDENCY_IWRAM_SIZE / sizeof(u32)]; // In IWRAM (.bss).
+EWRAM_DATA static u32 ewramArena[RESIDENCY_EWRAM_SIZE / sizeof(u32)];
+static u8 * const arenaData[ARENA_NUM] = {(u8*)iwramArena, (u8*)ewramArena};
+static const int arenaSize[ARENA_NUM] = {RESIDENCY_IWRAM_SIZE, RESIDENCY_EWRAM_SIZE};
+static int arenaUsed[ARENA_NUM];
+
+// The bookkeeping is only touched on scene switches, so it doesn't take up IWRAM.
+EWRAM_DATA static ResidentMesh meshes[RESIDENCY_MAX_MESHES];
+static int useCount; // Incremented by every residencyEnter.
+
+// The scene we're in, its instances, and what it got (cf. residencyPrint).
+static const char *currentScene = NULL;
+EWRAM_DATA static ModelInstancePool scenePools[RESIDENCY_MAX_POOLS];
+static int numScenePools;
+static int sceneMeshes, sceneArenaBytes[ARENA_NUM], sceneCopiedBytes, sceneRomBytes;
+
+INLINE int wordAligned(int bytes)
+{
+    return (bytes + 3) & ~3;
+}
+
+static int facesSize(const ResidentMesh *mesh)
+{
+    const int indexWords = mesh->numVerts <= MODEL_MAX_NARROW_VERTS ? 1 : 2; // cf. modelFaceVertexIndices
+    return mesh->numFaces * (sizeof(Face) + indexWords * sizeof(u32));
+}
+
+/* The size of the copies of the parts, or with data != NULL, points the copies to their place in data. */
+static int meshLayout(ResidentMesh *mesh, int parts, u8 *data)
+{
+    int size = 0;
+    if (parts & PART_VERTS) {
+        mesh->verts = data ? (PackedVec3*)(data + size) : NULL;
+        size += wordAligned(mesh->numVerts * sizeof(PackedVec3));
+    }
+    if (parts & PART_FACES) {
+        mesh->faces = data ? (Face*)(data + size) : NULL;
+        mesh->faceIndices = data ? (u32*)(data + size + mesh->numFaces * sizeof(Face)) : NULL;
+        size += facesSize(mesh);
+    }
+    if (parts & PART_NORMALS) {
+        mesh->vertNormals = data ? (PackedNormal*)(data + size) : NULL;
+        size += wordAligned(mesh->numVerts * sizeof(PackedNormal));
+    }
+    if (parts & PART_EDGES) {
+        mesh->edges = data ? (Edge*)(data + size) : NULL;
+        size += wordAligned(mesh->numEdges * sizeof(Edge));
+    }
+    return size;
+}
+
+/*
+    Moves the resident meshes of the arena to its beginning (in the order they're in), so all of its free space is at the end.
+    That's fine as no Model points to the copies while we're between scenes (cf. residencyLeave).
+*/
+static void arenaCompact(int arena)
+{
+    int used = 0;
+    while (true) {
+        ResidentMesh *next = NULL; // The mesh with the lowest offset which hasn't been moved yet.
+        for (int i = 0; i < RESIDENCY_MAX_MESHES; ++i) {
+            ResidentMesh *mesh = meshes + i;
+            if (mesh->parts && mesh->arena == arena && mesh->offset >= used && (next == NULL || mesh->offset < next->offset)) {
+                next = mesh;
+            }
+        }
+        if (next == NULL) {
+            break;
+        }
+        if (next->offset != used) {
+            memmove(arenaData[arena] + used, arenaData[arena] + next->offset, next->size);
+            next->offset = used;
+            meshLayout(next, next->parts, arenaData[arena] + used);
+        }
+        used += next->size;
+    }
+    arenaUsed[arena] = used;
+}
+
+/* Evicts the meshes the current scene doesn't use (the least recently used first) until there are size free bytes at the end of the arena; false (without evicting anything) if that's not possible. */
+static bool arenaMakeRoom(int arena, int size)
+{
+    arenaCompact(arena);
+    int evictable = 0;
+    for (int i = 0; i < RESIDENCY_MAX_MESHES; ++i) {
+        if (meshes[i].parts && meshes[i].arena == arena && !meshes[i].wantedParts) {
+            evictable += meshes[i].size;
+        }
+    }
+    if (arenaSize[arena] - arenaUsed[arena] + evictable < size) {
+        return false;
+    }
+    while (arenaSize[arena] - arenaUsed[arena] < size) {
+        ResidentMesh *lru = NULL;
+        for (int i = 0; i < RESIDENCY_MAX_MESHES; ++i) {
+            ResidentMesh *mesh = meshes + i;
+            if (mesh->parts && mesh->arena == arena && !mesh->wantedParts && (lru == NULL || mesh->lastUsed < lru->lastUsed)) {
+                lru = mesh;
+            }
+        }
+        lru->parts = 0;
+        arenaCompact(arena);
+    }
+    return true;
+}
+
+/* Copies the wanted parts of the mesh into the IWRAM arena if they fit, into the EWRAM arena otherwise; false if they fit into neither (the mesh stays in ROM then). */
+static bool meshLoad(ResidentMesh *mesh)
+{
+    const int size = meshLayout(mesh, mesh->wantedParts, NULL);
+#ifdef RESIDENCY_OFF
+    return false;
+#endif
+    int arena = ARENA_IWRAM;
+    if (!arenaMakeRoom(arena, size)) {
+        arena = ARENA_EWRAM;
+        if (!arenaMakeRoom(arena, size)) {
+            return false;
+        }
+    }
+    mesh->arena = arena;
+    mesh->offset = arenaUsed[arena];
+    mesh->size = size;
+    mesh->parts = mesh->wantedParts;
+    arenaUsed[arena] += size;
+    meshLayout(mesh, mesh->parts, arenaData[arena] + mesh->offset);
+    if (mesh->parts & PART_VERTS) {
+        memcpy(mesh->verts, mesh->romVerts, mesh->numVerts * sizeof(PackedVec3));
+    }
+    if (mesh->parts & PART_FACES) {
+        memcpy(mesh->faces, mesh->romFaces, mesh->numFaces * sizeof(Face));
+        memcpy(mesh->faceIndices, mesh->romFaceIndices, facesSize(mesh) - mesh->numFaces * sizeof(Face));
+    }
+    if (mesh->parts & PART_NORMALS) {
+        memcpy(mesh->vertNormals, mesh->romVertNormals, mesh->numVerts * sizeof(PackedNormal));
+    }
+    if (mesh->parts & PART_EDGES) {
+        memcpy(mesh->edges, mesh->romEdges, mesh->numEdges * sizeof(Edge));
+    }
+    return true;
+}
+
+/*
+    Calls fun for the model of each instance of the scene, and for its LODs (which are shared by the instances, so fun sees them several times).
+    The LODs are the global Models set up by obj2model.py's *ModelInit functions, so we may repoint them even though Model.lod is const.
+*/
+static void sceneForEachModel(void (*fun)(Model *model, PolygonShadingType shading))
+{
+    for (int p = 0; p < numScenePools; ++p) {
+        for (int i = 0; i < scenePools[p].POOL_CAPACITY; ++i) {
+            ModelInstance *instance = scenePools[p].instances + i;
+            if (instance->isEmpty) {
+                continue;
+            }
+            for (Model *model = &instance->state.mod; model != NULL; model = (Model*)model->lod) {
+                fun(model, instance->state.shading);
+            }
+        }
+    }
+}
+
+static ResidentMesh *meshFind(const PackedVec3 *romVerts)
+{
+    for (int i = 0; i < RESIDENCY_MAX_MESHES; ++i) {
+        if (meshes[i].romVerts == romVerts) {
+            return meshes + i;
+        }
+    }
+    return NULL;
+}
+
+/* The parts of the mesh an instance with the given shading reads every frame (cf. modelInstancesPrepareDraw in render/draw.c). */
+static int meshWantedParts(const Model *model, PolygonShadingType shading)
+{
+    if (shading == SHADING_WIREFRAME && model->edges != NULL) {
+        return PART_VERTS | PART_EDGES;
+    }
+    return PART_VERTS | PART_FACES | (shading == SHADING_GOURAUD && model->vertNormals != NULL ? PART_NORMALS : 0);
+}
+
+static void meshWant(Model *model, PolygonShadingType shading)
+{
+    if (!IN_ROM(model->verts)) { // e.g. the cube of model.c, or a Model which already points to copies (a LOD shared by several instances).
+        return;
+    }
+    ResidentMesh *mesh = meshFind(model->verts);
+    if (mesh == NULL) { // A free slot, or else the one of the least recently used mesh of the other scenes (which we evict, if it's resident).
+        for (int i = 0; i < RESIDENCY_MAX_MESHES && (mesh == NULL || mesh->romVerts != NULL); ++i) {
+            ResidentMesh *slot = meshes + i;
+            if (slot->romVerts == NULL || (!slot->wantedParts && (mesh == NULL || slot->lastUsed < mesh->lastUsed))) {
+                mesh = slot;
+            }
+        }
+        if (mesh == NULL) {
+            return; // The scene has more than RESIDENCY_MAX_MESHES meshes, this one stays in ROM.
+        }
+        *mesh = (ResidentMesh){.romVerts=model->verts, .romFaces=model->faces, .romFaceIndices=model->faceIndices, .romVertNormals=model->vertNormals, .romEdges=model->edges,
+                               .numVerts=model->numVerts, .numFaces=model->numFaces, .numEdges=model->numEdges, .parts=0, .wantedParts=0};
+    }
+    mesh->wantedParts |= meshWantedParts(model, shading);
+}
+
+static void meshRepoint(Model *model, PolygonShadingType shading)
+{
+    (void)shading;
+    const ResidentMesh *mesh = meshFind(model->verts);
+    if (mesh == NULL || !mesh->parts) {
+        return;
+    }
+    model->verts = mesh->verts;
+    if (mesh->parts & PART_FACES) {
+        model->faces = mesh->faces;
+        model->faceIndices = mesh->faceIndices;
+    }
+    if (mesh->parts & PART_NORMALS) {
+        model->vertNormals = mesh->vertNormals;
+    }
+    if (mesh->parts & PART_EDGES) {
+        model->edges = mesh->edges;
+    }
+}
+
+static void meshRestore(Model *model, PolygonShadingType shading)
+{
+    (void)shading;
+    for (int i = 0; i < RESIDENCY_MAX_MESHES; ++i) {
+        const ResidentMesh *mesh = meshes + i;
+        if (mesh->parts && model->verts == mesh->verts) {
+            model->verts = mesh->romVerts;
+            model->faces = mesh->romFaces;
+            model->faceIndices = mesh->romFaceIndices;
+            model->vertNormals = mesh->romVertNormals;
+            model->edges = mesh->romEdges;
+            return;
+        }
+    }
+}
+
+/* Makes the meshes of the instances in the pools resident (if they fit), and points the instances to them until residencyLeave. */
+void residencyEnter(const char *sceneName, const ModelInstancePool *pools, int numPools)
+{
+    assertion(numPools <= RESIDENCY_MAX_POOLS, "residency.c: residencyEnter: numPools <= RESIDENCY_MAX_POOLS");
+    residencyLeave(); // (In case we haven't left the last scene through sceneSwitchTo.)
+    currentScene = sceneName;
+    memcpy(scenePools, pools, numPools * sizeof(ModelInstancePool));
+    numScenePools = numPools;
+    ++useCount;
+
+    for (int i = 0; i < RESIDENCY_MAX_MESHES; ++i) {
+        meshes[i].wantedParts = 0;
+    }
+    sceneForEachModel(meshWant);
+    // Meshes which are resident with fewer parts than this scene draws (e.g. the edges, but not the faces) are copied anew.
+    for (int i = 0; i < RESIDENCY_MAX_MESHES; ++i) {
+        ResidentMesh *mesh = meshes + i;
+        if (mesh->wantedParts && (mesh->parts & mesh->wantedParts) != mesh->wantedParts) {
+            mesh->parts = 0;
+        }
+    }
+
+    sceneMeshes = 0;
+    sceneArenaBytes[ARENA_IWRAM] = sceneArenaBytes[ARENA_EWRAM] = 0;
+    sceneCopiedBytes = 0;
+    sceneRomBytes = 0;
+    for (int i = 0; i < RESIDENCY_MAX_MESHES; ++i) {
+        ResidentMesh *mesh = meshes + i;
+        if (!mesh->wantedParts) {
+            continue;
+        }
+        ++sceneMeshes;
+        mesh->lastUsed = useCount;
+        if (!mesh->parts) {
+            if (!meshLoad(mesh)) {
+                sceneRomBytes += meshLayout(mesh, mesh->wantedParts, NULL);
+                continue;
+            }
+            sceneCopiedBytes += mesh->size;
+        }
+        sceneArenaBytes[mesh->arena] += mesh->size;
+    }
+    sceneForEachModel(meshRepoint);
+}
+
+/* Points the instances of the scene back to ROM (the copies are kept for later, cf. residencyEnter). */
+void residencyLeave(void)
+{
+    sceneForEachModel(meshRestore);
+    numScenePools = 0;
+    currentScene = NULL;
+}
+
+/* The bytes of the meshes of the current scene which are resident, and the ones which didn't fit (and are read from ROM). */
+void residencyPrint(void)
+{
+    if (currentScene == NULL) {
+        return;
+    }
+    mgba_printf("Residency (%s): %d meshes, %d bytes in IWRAM, %d bytes in EWRAM (%d copied on entering), %d bytes in ROM",
+                currentScene, sceneMeshes, sceneArenaBytes[ARENA_IWRAM], sceneArenaBytes[ARENA_EWRAM], sceneCopiedBytes, sceneRomBytes);
+}
@@ -0,0 +1,26 @@
+#ifndef RESIDENCY_H
+#define RESIDENCY_H
+
+#include "model.h"
+
+/*
+    Model residency: The data of our models is in ROM, and every frame, all of it we draw is read through the 16-bit cartridge bus (with waitstates).
+    When a scene starts or resumes (cf. residencyEnter), the meshes of its instances (and of their LODs) are copied into RAM, and the instances are pointed
+    to the copies until the scene is left: Into an arena in IWRAM (32-bit bus, no waitstates) as long as they fit, the others into an arena in EWRAM
+    (still 16 bits, but fewer waitstates than ROM). Only the data the shading of an instance reads every frame is copied: The vertices, and either the faces
+    (with their vertex indices and, for SHADING_GOURAUD, the vertex normals) or the edges (SHADING_WIREFRAME); texels, texture coordinates and meshlets stay in ROM.
+    The copies are kept after their scene is left, so switching back and forth between scenes doesn't copy them again. If an arena is full,
+    the meshes of other scenes are evicted (the least recently used first), and if that's not enough, a mesh just stays in ROM.
+    Scenes call residencyEnter in their start and resume functions (after they've added their instances), sceneSwitchTo calls residencyLeave.
+    Instances added later on are drawn from ROM until their scene is entered again.
+*/
+#define RESIDENCY_IWRAM_SIZE 1024 // In bytes.
+#define RESIDENCY_EWRAM_SIZE (16 * 1024)
+#define RESIDENCY_MAX_MESHES 16 // The meshes of all scenes we keep track of (resident or not).
+#define RESIDENCY_MAX_POOLS 4
+
+void residencyEnter(const char *sceneName, const ModelInstancePool *pools, int numPools);
+void residencyLeave(void);
+void residencyPrint(void);
+
+#endif
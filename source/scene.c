@@ -4,6 +4,10 @@
 #include "logutils.h"
 #include "globals.h"
 #include "keyseq.h"
+#include "governor.h"
+#include "residency.h"
+#include "render/draw.h"
+#include "render/transformcache.h"
 
 // #define USER_SCENE_SWITCH
 
@@ -72,6 +76,9 @@ void sceneSwitchTo(SceneID sceneID)
 
     scenes[currentSceneID].draw();
     scenes[currentSceneID].pause();
+    governorStop(); // The next scene starts the governor with its own quality levels (if it wants to).
+    residencyLeave(); // The next scene makes its own meshes resident.
+    transformCacheReset(); // The cached instances of the scene we leave are in the way of the ones of the next scene.
     currentSceneID = sceneID;
 
     switch (g_mode) { // Clear the screen according to the mode we are switching from. 
@@ -140,6 +147,7 @@ void scenesDispatchDraw(void)
     int fps = getFps();
     char dbg[64];
     snprintf(dbg, sizeof(dbg),  "FPS: %d", fps);
+    drawMarkDirty(8, 8, 8 + 8 * strlen(dbg), 8 + 8);
     switch (g_mode) {
         case DCNT_MODE5:
             m5_puts(8, 8, dbg, CLR_LIME);
@@ -7,6 +7,7 @@
 #include "../camera.h"
 #include "../timer.h"
 #include "../render/draw.h"
+#include "../residency.h"
 
 #include "../../data-models/suzanneModel.h"
 
@@ -19,16 +20,13 @@ ModelInstance monkeyPoolBuffer[2];
 ModelInstancePool monkeyPool;
 ModelInstance *monkey, *cube;
 
-/* 
-    Current per-frame performance (it's above 30 FPS!): 
-    - directional: 
-    [INFO] GBA Debug: draw:c pre-rasterisation: 9.322998 ms (65 samples)
-    [INFO] GBA Debug: draw.c: total: 27.709961 ms (65 samples)
+// B cycles through the render resolutions (cf. drawSetResolution).
+static const int RESOLUTIONS[][2] = {{M5_SCALED_W, M5_SCALED_H}, {120, 80}, {80, 50}};
+static int resolutionIdx;
 
-    - point-light:
-    [INFO] GBA Debug: draw:c pre-rasterisation: 9.506104 ms (64 samples)
-    [INFO] GBA Debug: draw.c: total: 27.893066 ms (64 samples)
-*/ 
+// SELECT cycles through the hidden surface modes (cf. draw.h), so they can be compared on the same frame.
+static const DrawHiddenSurfaceMode HSR_MODES[] = {HSR_SBUFFER, HSR_TILED, HSR_PAINTERS};
+static int hsrIdx;
 
 void benchmarkSceneInit(void) 
 { 
@@ -39,8 +37,8 @@ void benchmarkSceneInit(void)
     lightDirection = (Vec3){.x = 0, .y = 0, .z=int2fx(-3)};
     lightDirection = vecUnit(lightDirection);
 
-    monkey = modelInstanceAddVanilla(&monkeyPool, suzanneModel, &(Vec3){.x=int2fx(0), .y=0, .z=int2fx(-4)}, int2fx(1), SHADING_FLAT_LIGHTING);
-    cube = modelInstanceAddVanilla(&monkeyPool, cubeModel, &(Vec3){.x=float2fx(-1.6), .y=0, .z=int2fx(-3)}, int2fx(2), SHADING_FLAT_LIGHTING);
+    monkey = modelInstanceAddVanilla(&monkeyPool, suzanneModel, &(Vec3){.x=int2fx(0), .y=0, .z=int2fx(-4)}, int2fx(1), SHADING_GOURAUD);
+    cube = modelInstanceAddVanilla(&monkeyPool, cubeModel, &(Vec3){.x=float2fx(-1.6), .y=0, .z=int2fx(-3)}, int2fx(2), SHADING_TEXTURED);
     cube->state.yaw = deg2fxangle(-45);
     cube->state.pitch = deg2fxangle(-45);
     cube->state.roll = deg2fxangle(12);
@@ -51,6 +49,14 @@ void benchmarkSceneInit(void)
 void benchmarkSceneUpdate(void) 
 {
     timerTick(&timer);
+    if (key_hit(KEY_B)) {
+        resolutionIdx = (resolutionIdx + 1) % (sizeof RESOLUTIONS / sizeof RESOLUTIONS[0]);
+        drawSetResolution(RESOLUTIONS[resolutionIdx][0], RESOLUTIONS[resolutionIdx][1]);
+    }
+    if (key_hit(KEY_SELECT)) {
+        hsrIdx = (hsrIdx + 1) % (sizeof HSR_MODES / sizeof HSR_MODES[0]);
+        drawSetHiddenSurfaceMode(HSR_MODES[hsrIdx]);
+    }
 
     cam.lookAt = monkey->state.pos;
 }
@@ -59,7 +65,9 @@ static bool lightToggle;
 IWRAM_CODE_ARM void benchmarkSceneDraw(void) 
 {
     drawBefore(&cam);
-    m5ScaledFill(CLR_BLACK);
+    if (HSR_MODES[hsrIdx] != HSR_TILED) { // The tiles clear the canvas themselves (cf. drawSetTileClearColor), and would overwrite this anyway.
+        m5ScaledClearDirty(CLR_BLACK);
+    }
     ModelDrawLightingData lightDataDir = {.type=LIGHT_DIRECTIONAL, .light.directional=&lightDirection, .attenuation=&lightAttenuation160};
     ModelDrawLightingData lightDataPoint = {.type=LIGHT_POINT, .light.directional=&cam.pos, .attenuation=&lightAttenuation160};
     if (key_hit(KEY_A)) {
@@ -76,6 +84,10 @@ void benchmarkSceneStart(void)
 {
     timerStart(&timer);
     videoM5ScaledInit();
+    drawSetHiddenSurfaceMode(HSR_MODES[hsrIdx]);
+    drawSetTileClearColor(CLR_BLACK);
+    drawSetResolution(RESOLUTIONS[resolutionIdx][0], RESOLUTIONS[resolutionIdx][1]);
+    residencyEnter("benchmarkScene", &monkeyPool, 1);
 }
 
 void benchmarkScenePause(void) 
@@ -87,4 +99,8 @@ void benchmarkSceneResume(void)
 {
     timerResume(&timer);
     videoM5ScaledInit();
+    drawSetHiddenSurfaceMode(HSR_MODES[hsrIdx]);
+    drawSetTileClearColor(CLR_BLACK);
+    drawSetResolution(RESOLUTIONS[resolutionIdx][0], RESOLUTIONS[resolutionIdx][1]);
+    residencyEnter("benchmarkScene", &monkeyPool, 1);
 }
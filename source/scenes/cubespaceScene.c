@@ -11,10 +11,21 @@
 #include "../logutils.h"
 #include "../timer.h"
 #include "../math.h"
+#include "../governor.h"
+#include "../residency.h"
 
 #define NUM_CUBES 9
 #define NUM_POINTS 200
 
+// Our budget is 30 FPS: Thin out the stars first, then give up the lighting of the cubes (and the far away ones).
+#define TARGET_FPS 30
+static const QualityLevel QUALITY_LEVELS[] = {
+        {.shadingDowngrade=0, .pointStride=1, .far=256, .decorativeInstances=0},
+        {.shadingDowngrade=0, .pointStride=2, .far=256, .decorativeInstances=0},
+        {.shadingDowngrade=1, .pointStride=4, .far=160, .decorativeInstances=0},
+        {.shadingDowngrade=2, .pointStride=4, .far=128, .decorativeInstances=0},
+};
+
 EWRAM_DATA static ModelInstance __cubesBuffer[NUM_CUBES];
 static ModelInstancePool cubePool;
 
@@ -55,6 +66,7 @@ void cubespaceSceneInit(void) {
 
 void cubespaceSceneUpdate(void) 
 {
+        camera.far = int2fx(governorSettings()->far);
         for (int i = 0; i < NUM_CUBES; ++i) {
                 FIXED_12 dir = i % 2 ? int2fx12(-1) : int2fx12(1);
                 cubePool.instances[i].state.yaw -= fx12mul(dir, fx12mul(timer.deltatime, deg2fxangle(120)) );
@@ -92,6 +104,8 @@ void cubespaceSceneDraw(void)
 void cubespaceSceneStart(void) 
 {
         videoM5ScaledInit();
+        governorStart(TARGET_FPS, QUALITY_LEVELS, sizeof QUALITY_LEVELS / sizeof QUALITY_LEVELS[0]);
+        residencyEnter("cubespaceScene", &cubePool, 1);
         timerStart(&timer);
 }
 
@@ -102,5 +116,7 @@ void cubespaceScenePause(void) {
 void cubespaceSceneResume(void) 
 {
         videoM5ScaledInit();
+        governorStart(TARGET_FPS, QUALITY_LEVELS, sizeof QUALITY_LEVELS / sizeof QUALITY_LEVELS[0]);
+        residencyEnter("cubespaceScene", &cubePool, 1);
         timerResume(&timer);
 }
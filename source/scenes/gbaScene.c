@@ -6,6 +6,7 @@
 #include "../globals.h"
 #include "../timer.h"
 #include "../render/draw.h"
+#include "../residency.h"
 
 #include "../../data-models/gbaModel.h"
 
@@ -47,18 +48,23 @@ void gbaSceneUpdate(void)
     }
 }
 
-INLINE void beGay(void) 
+/* Only redraws the stripes within the dirty rectangle (the rest of the page still shows them). */
+INLINE void beGay(DrawRect dirty) 
 {
     const COLOR RAINBOW[6] = {RGB15(31, 0, 3), RGB15(31, 20, 5), RGB15(31, 31, 8), RGB15(0, 16, 3), RGB15(0, 0, 30), RGB15(16, 0, 15)};
     for (int i = 0; i < 6; ++i) {
-        m5_rect(0, i * 16, 160, 3 + i * 16 + 16, RAINBOW[i]);
+        const int top = MAX(i * 16, dirty.top);
+        const int bottom = MIN(3 + i * 16 + 16, dirty.bottom);
+        if (top < bottom && dirty.left < dirty.right) {
+            m5_rect(dirty.left, top, dirty.right, bottom, RAINBOW[i]);
+        }
     }    
 }
 
 void gbaSceneDraw(void) 
 {
     drawBefore(&camera);
-    beGay();
+    beGay(drawDirtyRect());
     // ModelDrawLightingData lightDataPoint = {.type=LIGHT_POINT, .light.point=&camera.pos, .attenuation=&lightAttenuation100};
     ModelDrawLightingData lightDataDir = {.type=LIGHT_DIRECTIONAL, .light.directional=&lightDirection, .attenuation=NULL};
 
@@ -70,6 +76,7 @@ void gbaSceneStart(void)
 {
     timerStart(&timer);
     videoM5ScaledInit();
+    residencyEnter("gbaScene", &gbaPool, 1);
 }
 
 void gbaScenePause(void) 
@@ -81,4 +88,5 @@ void gbaSceneResume(void)
 {
     timerResume(&timer);
     videoM5ScaledInit();
+    residencyEnter("gbaScene", &gbaPool, 1);
 }
@@ -6,6 +6,7 @@
 #include "../globals.h"
 #include "../timer.h"
 #include "../render/draw.h"
+#include "../residency.h"
 
 #include "../../data-audio/AAS_Data.h"
 
@@ -129,6 +130,7 @@ void moleculeSceneStart(void)
 {
     timerStart(&timer);
     videoM5ScaledInit();
+    residencyEnter("moleculeScene", &modelPool, 1);
 }
 
 void moleculeScenePause(void) 
@@ -140,4 +142,5 @@ void moleculeSceneResume(void)
 {
     timerResume(&timer);
     videoM5ScaledInit();
+    residencyEnter("moleculeScene", &modelPool, 1);
 }
@@ -7,6 +7,8 @@
 #include "../timer.h"
 #include "../render/draw.h"
 #include "../math.h"
+#include "../governor.h"
+#include "../residency.h"
 
 #include "../../data-models/subwayModel.h"
 #include "../../data-models/treeModel.h"
@@ -26,7 +28,16 @@ static ModelInstance *subwayInstance;
 static Camera camera;
 static Vec3 lightDirection;
 
-static const int FAR = 202;
+#define FAR 202
+
+// Our budget is 20 FPS: We first give up the trees in the distance, then some of the rest, and only then fall back to wireframe.
+#define TARGET_FPS 20
+static const QualityLevel QUALITY_LEVELS[] = {
+    {.shadingDowngrade=0, .pointStride=1, .far=FAR, .decorativeInstances=NUM_TREES},
+    {.shadingDowngrade=0, .pointStride=1, .far=150, .decorativeInstances=NUM_TREES},
+    {.shadingDowngrade=0, .pointStride=1, .far=120, .decorativeInstances=6},
+    {.shadingDowngrade=1, .pointStride=1, .far=120, .decorativeInstances=2},
+};
 
 void subwaySceneInit(void) 
 { 
@@ -55,6 +66,16 @@ void subwaySceneInit(void)
 void subwaySceneUpdate(void) 
 {
     timerTick(&timer);
+
+    // Apply the quality level chosen by the governor (the trees are our decorative instances):
+    const QualityLevel *quality = governorSettings();
+    camera.far = int2fx(quality->far);
+    for (int i = 0; i < NUM_TREES; ++i) {
+        if (trees[i] != NULL) { // (Only the first half of the trees is actually placed in subwaySceneInit.)
+            trees[i]->state.hidden = i >= quality->decorativeInstances;
+        }
+    }
+
     const FIXED_12 camMoveDuration = int2fx12(10);
     const FIXED camMoveDurationZ = int2fx12(15);
     const FIXED_12 startTimeOffset = 1000;  
@@ -102,6 +123,9 @@ void subwaySceneStart(void)
     // This function is called only once, namely when your scene is first entered. Later, the resume function will be called instead. 
     timerStart(&timer);
     videoM5ScaledInit();
+    drawSetHiddenSurfaceMode(HSR_SBUFFER);
+    governorStart(TARGET_FPS, QUALITY_LEVELS, sizeof QUALITY_LEVELS / sizeof QUALITY_LEVELS[0]);
+    residencyEnter("subwayScene", &modelPool, 1);
 }
 
 void subwayScenePause(void) 
@@ -113,4 +137,7 @@ void subwaySceneResume(void)
 {
     timerResume(&timer);
     videoM5ScaledInit();
+    drawSetHiddenSurfaceMode(HSR_SBUFFER);
+    governorStart(TARGET_FPS, QUALITY_LEVELS, sizeof QUALITY_LEVELS / sizeof QUALITY_LEVELS[0]);
+    residencyEnter("subwayScene", &modelPool, 1);
 }
@@ -11,6 +11,7 @@
 #include "../model.h"
 #include "../logutils.h"
 #include "../timer.h"
+#include "../residency.h"
 
 #include "../../data-models/headModel.h"
 
@@ -41,7 +42,7 @@ static int perfDrawID, perfProjectID, perfSortID;
 void testbedSceneInit(void) 
 {     
         headModelInit(); 
-        camera = cameraNew((Vec3){.x=int2fx(0), .y=int2fx(0), .z=int2fx(20)}, CAMERA_VERTICAL_FOV_43_DEG, int2fx(1), int2fx(128), g_mode);
+        camera = cameraNew((Vec3){.x=int2fx(0), .y=int2fx(0), .z=int2fx(20)}, CAMERA_VERTICAL_FOV_43_DEG, int2fx(1), int2fx(128), DCNT_MODE4); // We render this scene in mode 4 at full resolution.
         timer = timerNew(TIMER_MAX_DURATION, TIMER_REGULAR);
         perfDrawID = performanceDataRegister("Drawing");
         perfProjectID = performanceDataRegister("3d-math");
@@ -72,8 +73,8 @@ void testbedSceneInit(void)
              }
         } 
         Vec3 headScale = {.x=int2fx(2),.y=int2fx(2), .z=int2fx(2)};
-        weirdHead = modelInstanceAdd(&headPool, headModel, &cubesCenter, &headScale, 0, deg2fxangle(-62), 0, SHADING_FLAT_LIGHTING);
-        weirdHead2 = modelInstanceAdd(&headPool, headModel, &cubesCenter, &headScale, 0, deg2fxangle(62), deg2fxangle(180), SHADING_FLAT_LIGHTING);
+        weirdHead = modelInstanceAdd(&headPool, headModel, &cubesCenter, &headScale, 0, deg2fxangle(-62), 0, SHADING_GOURAUD);
+        weirdHead2 = modelInstanceAdd(&headPool, headModel, &cubesCenter, &headScale, 0, deg2fxangle(62), deg2fxangle(180), SHADING_GOURAUD);
 }        
 
 
@@ -135,7 +136,7 @@ bool toggle = false;
 void testbedSceneDraw(void) 
 {
         drawBefore(&camera);
-        m5ScaledFill(CLR_BLACK);
+        m4_fill(M4_PAL_GREY(0));
 
         ModelDrawLightingData lightDataPoint = {.type=LIGHT_POINT, .light.point=&camera.pos, .attenuation=&lightAttenuation160};
         ModelDrawLightingData lightDataDir = {.type=LIGHT_DIRECTIONAL, .light.directional=&lightDirection, .attenuation=NULL};
@@ -156,7 +157,9 @@ void testbedSceneDraw(void)
 
 void testbedSceneStart(void) 
 {
-        videoM5ScaledInit();
+        videoM4Init();
+        setM4Pal3d();
+        residencyEnter("testbedScene", (ModelInstancePool[]){headPool, cubePool}, 2);
         testbedSceneUpdate();
         timerStart(&timer);
 }
@@ -166,6 +169,8 @@ void testbedScenePause(void) {
 }
 
 void testbedSceneResume(void) {
-        videoM5ScaledInit();
+        videoM4Init();
+        setM4Pal3d();
+        residencyEnter("testbedScene", (ModelInstancePool[]){headPool, cubePool}, 2);
         timerResume(&timer);
 }
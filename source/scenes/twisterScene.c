@@ -9,6 +9,7 @@
 #include "../logutils.h"
 #include "../timer.h"
 #include "../render/draw.h"
+#include "../render/spanfill.h"
 
 static Timer timer;
 
@@ -87,29 +88,6 @@ IWRAM_CODE_ARM void twisterSceneUpdate(void)
 }
 
 
-// Libtonc m4_hline, but without x1 x2 normalisation, as we can guarantee x1 < x2 (measurably better performance).
-INLINE void m4_hline_nonorm(int x1, int y, int x2, u32 clr)
-{
-	clr &= 0xFF;
-	uint width= x2-x1+1;
-	u16 *dstL= (u16*)((u8*)vid_page +y*(uint)M4_WIDTH + (x1&~1));
-	// --- Left unaligned pixel ---
-	if(x1&1)
-	{
-		*dstL= (*dstL & 0xFF) + (clr<<8);
-		width--;
-		dstL++;
-	}
-	// --- Right unaligned pixel ---
-	if(width&1)
-		dstL[width/2]= (dstL[width/2]&~0xFF) + clr;
-	width /= 2;
-	// --- Aligned line ---
-	if(width)
-	    memset16(dstL, dup8(clr), width);
-}
-
-
 IWRAM_CODE_ARM static void renderTwisters(Twister **tw, int num) 
 {
     // cf. https://en.wikipedia.org/wiki/Insertion_sort (last retrieved 2021-07-09)
@@ -1,7 +1,10 @@
+import heapq
 import math
 import pathlib
 import re
+import struct
 import textwrap
+import zlib
 from typing import Dict
 
 MAX_FX8 = 2**23 - 1 # Largest number representable as 24.8 fixed point. We will never run into it with non-ridiculous data. 
@@ -9,6 +12,67 @@ MAX_FX8 = 2**23 - 1 # Largest number representable as 24.8 fixed point. We will
 def float2fx8(n): 
     return int(n * 256)
 
+def pack_normal(n):
+    """ A normal (of any length) as a unit vector in .7 fixed point (cf. PackedNormal in source/model.h), 1.0 is clamped to 127. """
+    length = math.sqrt(sum(c * c for c in n))
+    if length < 1e-9:
+        return [0, 0, 0]
+    return [max(-127, min(127, round(c / length * 128))) for c in n]
+
+def rgb2rgb15(r, g, b):
+    return (r >> 3) + ((g >> 3) << 5) + ((b >> 3) << 10)
+
+def png_read(filename: pathlib.Path):
+    """ Minimal PNG decoder (8-bit greyscale/RGB/palette/RGBA, non-interlaced) so we don't depend on any third-party modules. Returns (width, height, rows of (r, g, b) tuples). """
+    data = open(filename, "rb").read()
+    if data[:8] != b"\x89PNG\r\n\x1a\n":
+        raise ValueError(f"'{filename}' is not a PNG file.")
+    pos, idat, palette = 8, b"", []
+    width = height = bit_depth = color_type = interlace = None
+    while pos < len(data):
+        length, chunk_type = struct.unpack(">I4s", data[pos:pos + 8])
+        chunk = data[pos + 8:pos + 8 + length]
+        pos += 12 + length
+        if chunk_type == b"IHDR":
+            width, height, bit_depth, color_type, _, _, interlace = struct.unpack(">IIBBBBB", chunk)
+        elif chunk_type == b"PLTE":
+            palette = [tuple(chunk[i:i + 3]) for i in range(0, len(chunk), 3)]
+        elif chunk_type == b"IDAT":
+            idat += chunk
+        elif chunk_type == b"IEND":
+            break
+    channels = {0: 1, 2: 3, 3: 1, 4: 2, 6: 4}.get(color_type)
+    if bit_depth != 8 or interlace != 0 or channels is None:
+        raise ValueError(f"'{filename}': Only non-interlaced 8-bit greyscale, RGB, RGBA, and palette PNGs are supported.")
+    raw = zlib.decompress(idat)
+    stride = width * channels
+    rows, prev = [], bytearray(stride)
+    for y in range(height):
+        filter_type = raw[y * (stride + 1)]
+        line = bytearray(raw[y * (stride + 1) + 1:(y + 1) * (stride + 1)])
+        for x in range(stride): # cf. https://www.w3.org/TR/PNG/#9Filters
+            a = line[x - channels] if x >= channels else 0
+            b = prev[x]
+            c = prev[x - channels] if x >= channels else 0
+            if filter_type == 1:
+                line[x] = (line[x] + a) & 0xff
+            elif filter_type == 2:
+                line[x] = (line[x] + b) & 0xff
+            elif filter_type == 3:
+                line[x] = (line[x] + ((a + b) >> 1)) & 0xff
+            elif filter_type == 4:
+                p = a + b - c
+                pa, pb, pc = abs(p - a), abs(p - b), abs(p - c)
+                line[x] = (line[x] + (a if pa <= pb and pa <= pc else (b if pb <= pc else c))) & 0xff
+        prev = line
+        if color_type == 3:
+            rows.append([palette[i] for i in line])
+        elif color_type in (0, 4):
+            rows.append([(line[i], line[i], line[i]) for i in range(0, stride, channels)])
+        else:
+            rows.append([tuple(line[i:i + 3]) for i in range(0, stride, channels)])
+    return width, height, rows
+
 class Model:
     class ModelParseError(Exception):
         pass
@@ -16,28 +80,50 @@ class Model:
     class Face:
         def __init__(self):
             self.vert_idx = []
+            self.tex_idx = []
             self.normal_idx: int
+            self.vert_normal_idx = [] # The normal of each corner of the face (for smooth shading, those differ from the face normal). 
             self.color = (31, 31, 31)
+
+        def corners(self, corner_indices):
+            """ A face with a subset of the corners of this face (e.g. one triangle of a polygon). """
+            face = Model.Face()
+            face.vert_idx = [self.vert_idx[i] for i in corner_indices]
+            face.tex_idx = [self.tex_idx[i] for i in corner_indices] if len(self.tex_idx) == len(self.vert_idx) else []
+            face.vert_normal_idx = [self.vert_normal_idx[i] for i in corner_indices]
+            face.normal_idx = self.normal_idx
+            face.color = self.color
+            return face
         
-    def __init__(self, filename: pathlib.Path, max_model_verts=None, max_model_faces=None):
-        self.name = re.sub(r"\W", "", filename.stem) # Remove non-word characters.
+    def __init__(self, filename: pathlib.Path, max_model_verts=None, max_model_faces=None, max_model_edges=None, merge_quads=True, name=None, mtl_file=None):
+        self.name = re.sub(r"\W", "", filename.stem) if name is None else name # Remove non-word characters.
         if len(self.name) < 1:
             raise Model.ModelParseError(f"'{self.name}' is not a valid model name. It also should be a valid name for a C identifier (I don't validate that properly, but it *should*).")
         self.verts = []
+        self.vert_shift = 0 # The vertices are stored shifted right by that much (cf. pack_verts).
         self.faces = []
         self.normals = []
+        self.tex_coords = []
         self.materials = {}
+        self.material_textures = {}
+        self.texture_file = None
+        self.texture = None # (width, height, rows) of the texture of the model (we only support one texture per model).
         self.max_model_faces = max_model_faces
+        self.max_model_edges = max_model_edges
         self.max_model_verts = max_model_verts
         self.input_filename = filename
+        self.merge_quads = merge_quads
+        self.lods = [] 
+        self.mtl_file = pathlib.Path(filename).with_suffix(".mtl") if mtl_file is None else mtl_file
         self.obj_parse(filename)
 
     def material_parse(self): 
-        mtl_file = pathlib.Path(self.input_filename).with_suffix(".mtl")
+        mtl_file = self.mtl_file
         if mtl_file.exists():
             current_mtl = ""
-            for line in open(mtl_file):
-                line = line.strip().lower()
+            for original_line in open(mtl_file):
+                original_line = original_line.strip()
+                line = original_line.lower()
                 line_toks = line.split()
 
                 if len(line_toks) == 2 and line_toks[0] == "newmtl":
@@ -47,6 +133,9 @@ class Model:
                 elif len(line_toks) >= 4 and line_toks[0] == "kd":
                     self.materials[current_mtl] = (int(float(line_toks[1]) * 31), int(float(line_toks[2]) * 31), int(float(line_toks[3]) * 31))
 
+                elif len(line_toks) >= 2 and line_toks[0] == "map_kd": # Diffuse texture (we ignore texture options, and take the file name as is, not lowercased).
+                    self.material_textures[current_mtl] = mtl_file.parent.joinpath(original_line.split()[-1])
+
     def obj_parse(self, filename: pathlib.Path):
         float2fx8 = lambda n: int(n * 256) 
 
@@ -69,6 +158,14 @@ class Model:
             elif line_toks[0] == "usemtl": # Face material
                 current_mtl = "".join(line_toks[1:])
 
+            elif line_toks[0] == "vt": # Texture coordinates:
+                if len(line_toks) < 3:
+                    raise Model.ModelParseError(f"Problem in {filename} on line {line_num+1}: Texture coordinate has {len(line_toks) - 1} values, but must have at least 2.")
+                try: # We use the top-left corner of the texture as the origin (.obj uses the bottom-left corner).
+                    self.tex_coords.append((float2fx8(float(line_toks[1])), float2fx8(1 - float(line_toks[2]))))
+                except ValueError:
+                    raise Model.ModelParseError(f"Problem in {filename} on line {line_num+1}: Texture coordinate contains non-number value.")
+
             elif line.startswith("vn"): # Normals:
                 if (len(line_toks) != 4):
                     raise Model.ModelParseError(f"Problem in {filename} on line {line_num+1}: Vertex-normal has {len(line_toks) - 1} values, but must have exactly 3.")
@@ -99,11 +196,16 @@ class Model:
                     raise Model.ModelParseError(f"Problem in {filename} on line {line_num+1}: Vertex contains non-number value.")
 
             elif line.startswith("f"): # Faces:
-                if len(line_toks) != 4:
-                    raise Model.ModelParseError(f"Problem in {filename} on line {line_num+1}: Face has {len(line_toks) - 1} vertices, but must have exactly 3 (only tris are supported for now, did you triangulate your self ?).")
+                if len(line_toks) < 4:
+                    raise Model.ModelParseError(f"Problem in {filename} on line {line_num+1}: Face has {len(line_toks) - 1} vertices, but must have at least 3.")
                 face = Model.Face()
                 if current_mtl and current_mtl != "none": # FIXME: The != "none" check is potentially bad (what if someone names a material none?) Investigate why...
                     face.color = self.materials[current_mtl]
+                    texture_file = self.material_textures.get(current_mtl)
+                    if texture_file is not None:
+                        if self.texture_file is not None and self.texture_file != texture_file:
+                            raise Model.ModelParseError(f"Problem in {filename} on line {line_num+1}: Only one texture per model is supported, but the model uses '{self.texture_file}' and '{texture_file}'.")
+                        self.texture_file = texture_file
 
                 faceHasNormal = False
                 for i, vertData in enumerate(line_toks[1:]):
@@ -114,8 +216,16 @@ class Model:
                             raise Model.ModelParseError(f"Problem in {filename} on line {line_num+1}: Vertex index out of range.")
                         
                         face.vert_idx.append(vertIdx)
+                        if len(indices) >= 2 and indices[1]:
+                            texIdx = int(indices[1]) - 1 # Subtract 1, see above. 
+                            if texIdx < 0 or texIdx >= len(self.tex_coords):
+                                raise Model.ModelParseError(f"Problem in {filename} on line {line_num+1}: Texture coordinate index out of range.")
+                            face.tex_idx.append(texIdx)
                         if len(indices) == 3:
                             face.normal_idx = int(indices[2]) - 1 # Subtract 1, see above. 
+                            if face.normal_idx < 0 or face.normal_idx >= len(self.normals):
+                                raise Model.ModelParseError(f"Problem in {filename} on line {line_num+1}: Normal index out of range.")
+                            face.vert_normal_idx.append(face.normal_idx)
                             faceHasNormal = True
                     except ValueError as err:
                         raise Model.ModelParseError(f"Problem in {filename} on line {line_num+1}: '{line}' contains an invalid, non-integer vertex/normal index.")
@@ -123,8 +233,19 @@ class Model:
                 if not faceHasNormal:
                     raise Model.ModelParseError(f"Problem in {filename} on line {line_num+1}: Face has no normal.")
 
-                self.faces.append(face)
-        
+                self.add_polygon(face)
+
+        self.pack_verts()
+        if self.merge_quads:
+            self.merge_triangles_into_quads()
+
+        if self.texture_file is not None:
+            if not self.texture_file.exists():
+                raise Model.ModelParseError(f"Texture '{self.texture_file}' of {filename} not found.")
+            width, height, rows = png_read(self.texture_file)
+            if width & (width - 1) or height & (height - 1) or width > 256 or height > 256:
+                raise Model.ModelParseError(f"Texture '{self.texture_file}' of {filename} is {width}x{height}, but its width and height must be powers of two (and at most 256).")
+            self.texture = (width, height, rows)
 
         if self.max_model_verts != None and len(self.verts) > self.max_model_verts:
             raise Model.ModelParseError(f"Model has {len(self.verts)} vertices while MAX_MODEL_VERTS is {self.max_model_verts}.")
@@ -132,56 +253,406 @@ class Model:
         if self.max_model_faces != None and len(self.faces) > self.max_model_faces:
             raise Model.ModelParseError(f"Model has {len(self.faces)} faces while MAX_MODEL_FACES is {self.max_model_faces}.")
 
-
-    def generate_code(self) ->Dict:
-        # Header file: 
-        header_file = textwrap.dedent(f"""
-        #ifndef {self.name}Model_H
-        #define {self.name}Model_H
-        #include "../source/model.h"
-
-        extern Model {self.name}Model;
-        void {self.name}ModelInit(void);
-
-        #endif
-        """)
-        # Implementation/data file:
-        verts_string = f"const Vec3 {self.name}Verts[{len(self.verts)}] = {{"
+        if self.max_model_edges != None and len(self.unique_edges()) > self.max_model_edges:
+            raise Model.ModelParseError(f"Model has {len(self.unique_edges())} edges while MAX_MODEL_EDGES is {self.max_model_edges}.")
+
+
+    def pack_verts(self):
+        """ 
+        The vertices are stored with 16 bits per component (cf. PackedVec3 in source/math.h), shifted right by the smallest vert_shift which makes them fit. 
+        We round them to multiples of 2**vert_shift right away, so everything we compute from them (plane distances, bounding spheres, meshlets) matches what's drawn. 
+        """
+        fits = lambda shift: all(-2**15 <= round(c / 2**shift) < 2**15 for vert in self.verts for c in vert)
+        self.vert_shift = 0
+        while not fits(self.vert_shift):
+            self.vert_shift += 1
+        self.verts = [[round(c / 2**self.vert_shift) << self.vert_shift for c in vert] for vert in self.verts]
+
+    def is_convex_planar(self, vert_idx):
+        """ Whether the polygon is planar (within a small tolerance) and strictly convex, i.e. whether we can draw it as a ConvexPlanarQuadFace. """
+        pts = [[c / 256 for c in self.verts[i]] for i in vert_idx]
+        n = len(pts)
+        normal = [0.0, 0.0, 0.0] # Newell's method
+        for i in range(n):
+            a, b = pts[i], pts[(i + 1) % n]
+            normal[0] += (a[1] - b[1]) * (a[2] + b[2])
+            normal[1] += (a[2] - b[2]) * (a[0] + b[0])
+            normal[2] += (a[0] - b[0]) * (a[1] + b[1])
+        length = math.sqrt(sum(c * c for c in normal))
+        size = max(math.dist(pts[i], pts[(i + 1) % n]) for i in range(n))
+        if length < 1e-9 or size < 1e-9:
+            return False
+        normal = [c / length for c in normal]
+        dot = lambda a, b: sum(x * y for x, y in zip(a, b))
+        if any(abs(dot(normal, [p[k] - pts[0][k] for k in range(3)])) > 0.01 * size for p in pts):
+            return False
+        for i in range(n):
+            a, b, c = pts[i], pts[(i + 1) % n], pts[(i + 2) % n]
+            e1 = [b[k] - a[k] for k in range(3)]
+            e2 = [c[k] - b[k] for k in range(3)]
+            cross = [e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0]]
+            if dot(cross, normal) <= 1e-4 * size * size:
+                return False
+        return True
+
+    def add_polygon(self, face):
+        """ Keeps triangles and convex planar quads as they are, and splits everything else into triangles (a fan, which is correct for convex polygons). """
+        n = len(face.vert_idx)
+        if n == 3 or (n == FACE_MAX_VERTS and self.is_convex_planar(face.vert_idx)):
+            self.faces.append(face)
+        else:
+            for i in range(1, n - 1):
+                self.faces.append(face.corners([0, i, i + 1]))
+
+    def merge_triangles_into_quads(self):
+        """ 
+        Models are usually exported triangulated, so we merge pairs of triangles which share an edge back into convex planar quads 
+        (if they have the same colour, and the same texture coordinates and normals along the shared edge). 
+        Quads are culled, lit and sorted once, and rasterised in one go, so that's a lot cheaper than two triangles. 
+        We prefer merging across the longest shared edge (which is usually the diagonal the exporter introduced).
+        """
+        edges = {} # (vert_idx a, vert_idx b) -> index of the triangle which contains the directed edge a -> b
+        for face_idx, face in enumerate(self.faces):
+            if len(face.vert_idx) == 3:
+                for i in range(3):
+                    edges[(face.vert_idx[i], face.vert_idx[(i + 1) % 3])] = face_idx
+        edge_len = lambda a, b: math.dist(self.verts[a], self.verts[b])
+        merged = {} # face index -> quad, or None if the face was merged into another one's quad.
+        for face_idx, face in enumerate(self.faces):
+            if len(face.vert_idx) != 3 or face_idx in merged:
+                continue
+            candidates = sorted(range(3), key=lambda i: -edge_len(face.vert_idx[i], face.vert_idx[(i + 1) % 3]))
+            for i in candidates:
+                a, b, c = face.vert_idx[i], face.vert_idx[(i + 1) % 3], face.vert_idx[(i + 2) % 3]
+                other_idx = edges.get((b, a)) # With a consistent winding order, the neighbour has the shared edge the other way round.
+                if other_idx is None or other_idx == face_idx or other_idx in merged:
+                    continue
+                other = self.faces[other_idx]
+                j = other.vert_idx.index(b)
+                if other.color != face.color or other.vert_idx[(j + 1) % 3] != a:
+                    continue
+                # The quad (a, q, b, c) replaces the edge a -> b of the triangle by a -> q -> b, which keeps the winding order.
+                q_corner = (j + 2) % 3
+                if other.vert_idx[q_corner] in (a, b, c):
+                    continue
+                quad = face.corners([i, i, (i + 1) % 3, (i + 2) % 3])
+                quad.vert_idx[1] = other.vert_idx[q_corner]
+                quad.vert_normal_idx[1] = other.vert_normal_idx[q_corner]
+                if quad.tex_idx:
+                    if len(other.tex_idx) != 3:
+                        continue
+                    quad.tex_idx[1] = other.tex_idx[q_corner]
+                    if other.tex_idx[j] != face.tex_idx[(i + 1) % 3] or other.tex_idx[(j + 1) % 3] != face.tex_idx[i]:
+                        continue
+                elif other.tex_idx:
+                    continue
+                if other.vert_normal_idx[j] != face.vert_normal_idx[(i + 1) % 3] or other.vert_normal_idx[(j + 1) % 3] != face.vert_normal_idx[i]:
+                    continue
+                if not self.is_convex_planar(quad.vert_idx):
+                    continue
+                merged[face_idx] = quad
+                merged[other_idx] = None
+                break
+        self.faces = [merged.get(face_idx, face) for face_idx, face in enumerate(self.faces) if merged.get(face_idx, face) is not None]
+
+    def vertex_normals(self):
+        """ Per-vertex normals for Gouraud shading: The normalised sum of the normals of all face corners which share the vertex. """
+        sums = [[0.0, 0.0, 0.0] for _ in self.verts]
+        for face in self.faces:
+            for vert_idx, normal_idx in zip(face.vert_idx, face.vert_normal_idx):
+                for axis in range(3):
+                    sums[vert_idx][axis] += self.normals[normal_idx][axis] / 256
+        return [pack_normal(n) for n in sums] # (Vertices which aren't part of any face don't need a normal, they get 0.)
+
+    def unique_edges(self):
+        """ 
+        The edges for wireframe rendering, each one only once (neighbouring faces share their edges, and double-sided models even have two faces with the same edges). 
+        Every edge gets the colour of the first face it belongs to. 
+        """
+        edges = {} # (smaller vert_idx, larger vert_idx) -> color
+        for face in self.faces:
+            n = len(face.vert_idx)
+            for i in range(n):
+                a, b = face.vert_idx[i], face.vert_idx[(i + 1) % n]
+                if a != b:
+                    edges.setdefault((min(a, b), max(a, b)), face.color)
+        return list(edges.items())
+
+    def bounding_sphere(self):
+        """ 
+        The bounding sphere of the vertices (centred on their bounding box, which is close enough to the minimal sphere for our models) for frustum culling. 
+        The radius is rounded up, so the sphere stays conservative in fixed point. It encloses the LODs of the model as well (the culling doesn't know which LOD is drawn).
+        """
+        verts = self.verts + [vert for lod in self.lods for vert in lod.verts]
+        if not verts:
+            return [0, 0, 0], 0
+        center = [(min(v[axis] for v in verts) + max(v[axis] for v in verts)) // 2 for axis in range(3)]
+        radius = max(math.dist(center, v) for v in verts)
+        return center, math.ceil(radius) + 1
+
+    def build_meshlets(self):
+        """
+        Splits the faces into meshlets (cf. Meshlet in source/model.h) of up to MESHLET_MAX_FACES faces, and reorders self.faces so each one is a contiguous range. 
+        A meshlet grows from a seed face over the faces sharing vertices with it, preferring the ones close to the seed and facing the same way 
+        (so the bounding spheres stay small and the normal cones narrow), or, if there are none, over the closest ones which don't share vertices with it. 
+        Faces further than MESHLET_MAX_SEED_DIST from the seed or facing too differently are left for other meshlets. 
+        Meshlets which end up with fewer than MESHLET_MIN_FACES faces are merged into a neighbouring one (cf. merge_small_meshlets). 
+        Returns the meshlets as (first face, number of faces, centre, radius, cone axis, cone cutoff), or an empty list if the model is small enough to be processed face by face.
+        """
+        if len(self.faces) <= MESHLET_MAX_FACES:
+            return []
+        centroids = [[sum(self.verts[idx][axis] for idx in face.vert_idx) / len(face.vert_idx) for axis in range(3)] for face in self.faces]
+        normals = []
+        for face in self.faces: # (The packed normals, which are the ones the faces are culled with.)
+            n = pack_normal(self.normals[face.normal_idx])
+            length = math.sqrt(sum(c * c for c in n))
+            normals.append([c / length for c in n] if length > 0 else [0.0, 0.0, 0.0])
+        faces_of_vert = {}
+        for i, face in enumerate(self.faces):
+            for idx in face.vert_idx:
+                faces_of_vert.setdefault(idx, []).append(i)
+        size = max(self.bounding_sphere()[1], 1)
+        dot = lambda a, b: sum(x * y for x, y in zip(a, b))
+
+        unassigned = set(range(len(self.faces)))
+        clusters = []
+        while unassigned:
+            seed = min(unassigned)
+            cost = lambda i: math.dist(centroids[i], centroids[seed]) / size + MESHLET_NORMAL_WEIGHT * (1 - dot(normals[i], normals[seed]))
+            # Otherwise, the normal cone would get too wide to be of any use (or the bounding sphere too big).
+            compatible = lambda i: i == seed or (dot(normals[i], normals[seed]) >= MESHLET_MIN_NORMAL_DOT and math.dist(centroids[i], centroids[seed]) <= MESHLET_MAX_SEED_DIST * size)
+            cluster = []
+            frontier = [(0.0, seed)]
+            queued = {seed}
+            while len(cluster) < MESHLET_MAX_FACES:
+                if not frontier: # The faces we've got so far aren't connected to any others (e.g. the atoms of a molecule), so we continue with the closest one near the seed.
+                    candidates = [i for i in unassigned if compatible(i)]
+                    if not candidates:
+                        break
+                    closest = min(candidates, key=cost)
+                    frontier.append((cost(closest), closest))
+                    queued.add(closest)
+                _, i = heapq.heappop(frontier)
+                if not compatible(i): # (It's left for another meshlet.)
+                    continue
+                unassigned.remove(i)
+                cluster.append(i)
+                for idx in self.faces[i].vert_idx:
+                    for j in faces_of_vert[idx]:
+                        if j in unassigned and j not in queued:
+                            queued.add(j)
+                            heapq.heappush(frontier, (cost(j), j))
+            clusters.append(cluster)
+        clusters = self.merge_small_meshlets(clusters, normals, centroids, size)
+
+        self.faces = [self.faces[i] for cluster in clusters for i in cluster]
+        meshlets = []
+        first = 0
+        for cluster in clusters:
+            verts = [self.verts[idx] for face in self.faces[first:first + len(cluster)] for idx in face.vert_idx] # (Only its own vertices, so the sphere stays small.)
+            center = [(min(v[axis] for v in verts) + max(v[axis] for v in verts)) // 2 for axis in range(3)]
+            radius = math.ceil(max(math.dist(center, v) for v in verts)) + 1
+            axis = [sum(normals[i][k] for i in cluster) for k in range(3)]
+            length = math.sqrt(sum(c * c for c in axis))
+            cutoff = 256 # No cone (the normals point in all directions).
+            if length > 1e-6:
+                axis = [c / length for c in axis]
+                min_dot = min(dot(normals[i], axis) for i in cluster)
+                angle = math.acos(max(-1.0, min(1.0, min_dot))) + MESHLET_CONE_SLACK
+                if angle < math.pi / 2:
+                    cutoff = min(256, math.ceil(math.sin(angle) * 256))
+            axis_fx = [float2fx8(c) for c in axis] if length > 1e-6 else [0, 0, 0]
+            meshlets.append((first, len(cluster), center, radius, axis_fx, cutoff))
+            first += len(cluster)
+        return meshlets
+
+    def merge_small_meshlets(self, clusters, normals, centroids, size):
+        """
+        Merges the clusters of faces with fewer than MESHLET_MIN_FACES faces (the scraps left between the others) into the neighbouring cluster 
+        (sharing a vertex) they make the narrowest normal cone and the smallest bounding sphere with, as long as it stays within MESHLET_MERGED_MAX_FACES faces. 
+        Clusters without such a neighbour (e.g. small separate parts of the model) are merged into the closest one within MESHLET_MAX_SEED_DIST of it instead, 
+        and if there isn't any, they're kept as they are. The smallest clusters are merged first.
+        """
+        def axis_of(cluster):
+            axis = [sum(normals[i][k] for i in cluster) for k in range(3)]
+            length = math.sqrt(sum(c * c for c in axis))
+            return [c / length for c in axis] if length > 1e-6 else [0.0, 0.0, 0.0]
+        def cone_of(cluster): # The cosine of the opening angle, negated (so smaller is narrower).
+            axis = axis_of(cluster)
+            return -min(sum(a * b for a, b in zip(normals[i], axis)) for i in cluster)
+        def radius_of(cluster):
+            verts = [self.verts[idx] for i in cluster for idx in self.faces[i].vert_idx]
+            center = [(min(v[k] for v in verts) + max(v[k] for v in verts)) / 2 for k in range(3)]
+            return max(math.dist(center, v) for v in verts)
+        def centre_of(cluster):
+            return [sum(centroids[i][k] for i in cluster) / len(cluster) for k in range(3)]
+        clusters = [list(cluster) for cluster in clusters]
+        kept = set() # The ones which are too small, but can't be merged anywhere.
+        while True:
+            small = [c for c in range(len(clusters)) if len(clusters[c]) < MESHLET_MIN_FACES and c not in kept]
+            if not small:
+                break
+            c = min(small, key=lambda c: len(clusters[c]))
+            verts = {idx for i in clusters[c] for idx in self.faces[i].vert_idx}
+            fits = [o for o in range(len(clusters)) if o != c and len(clusters[o]) + len(clusters[c]) <= MESHLET_MERGED_MAX_FACES]
+            neighbours = [o for o in fits if any(idx in verts for i in clusters[o] for idx in self.faces[i].vert_idx)]
+            centre = centre_of(clusters[c])
+            if neighbours:
+                target = min(neighbours, key=lambda o: cone_of(clusters[o] + clusters[c]) + radius_of(clusters[o] + clusters[c]) / size)
+            else:
+                close = [o for o in fits if math.dist(centre_of(clusters[o]), centre) <= MESHLET_MAX_SEED_DIST * size]
+                if not close:
+                    kept.add(c)
+                    continue
+                target = min(close, key=lambda o: math.dist(centre_of(clusters[o]), centre))
+            clusters[target] += clusters[c]
+            del clusters[c]
+            kept = {k - (k > c) for k in kept}
+        return clusters
+
+    def meshlet_report(self, meshlets):
+        """ 
+        A line about the meshlets of the model (their number, size, bounding spheres and normal cones), so we can tell whether culling them is worth it. 
+        The cone culling rate is the share of the faces whose meshlet fails the cone test (cf. meshletTest in source/render/draw.c), averaged over cameras 
+        at 4 times the radius of the model, looking at it from the 26 directions of a 3x3x3 grid (about half of the faces face away from any of them).
+        """
+        if not meshlets:
+            return f"{self.name}: {len(self.faces)} faces, no meshlets"
+        counts = [m[1] for m in meshlets]
+        radii = [m[3] for m in meshlets]
+        angles = [math.degrees(math.asin(m[5] / 256)) for m in meshlets if m[5] < 256]
+        cones = f"cone half-angles {min(angles):.0f}-{max(angles):.0f} degrees ({len(meshlets) - len(angles)} without a cone)" if angles else "no cones"
+        center, radius = self.bounding_sphere()
+        directions = [(x, y, z) for x in (-1, 0, 1) for y in (-1, 0, 1) for z in (-1, 0, 1) if x or y or z]
+        culled = 0
+        for direction in directions:
+            length = math.sqrt(sum(c * c for c in direction))
+            cam = [center[k] + direction[k] / length * 4 * radius for k in range(3)]
+            for _, count, m_center, m_radius, axis, cutoff in meshlets:
+                d = [m_center[k] - cam[k] for k in range(3)]
+                ahead = sum(d[k] * axis[k] / 256 for k in range(3)) - m_radius
+                if ahead > 0 and ahead >= cutoff / 256 * math.sqrt(sum(c * c for c in d)):
+                    culled += count
+        return (f"{self.name}: {len(self.faces)} faces in {len(meshlets)} meshlets of {min(counts)}-{max(counts)} faces (avg. {sum(counts) / len(counts):.0f}), "
+            f"radii {min(radii)}-{max(radii)} (avg. {sum(radii) / len(radii):.0f}, model {radius}), {cones}, {100 * culled / (len(directions) * len(self.faces)):.0f}% of the faces cone culled")
+
+    def generate_data(self):
+        """ The data of the model (and the Model itself) as C definitions, and the calls which set up the Model at runtime. """
+        verts_string = f"const PackedVec3 {self.name}Verts[{len(self.verts)}] = {{"
         faces_string = f"const Face {self.name}Faces[{len(self.faces)}] = {{"
+        narrow_indices = len(self.verts) <= MODEL_MAX_NARROW_VERTS # One word of 8-bit indices per face, otherwise two words of 16-bit indices (cf. modelFaceVertexIndices).
+        face_indices_string = f"const u32 {self.name}FaceIndices[{len(self.faces) * (1 if narrow_indices else 2)}] = {{"
+        vert_normals_string = f"const PackedNormal {self.name}VertNormals[{len(self.verts)}] = {{"
+        edges = self.unique_edges()
+        edges_string = f"const Edge {self.name}Edges[{len(edges)}] = {{"
         model_string = f"Model {self.name}Model;" 
-        model_initfun= f"void {self.name}ModelInit(void) {{ {self.name}Model = modelNew({self.name}Verts, {self.name}Faces, {len(self.verts)}, {len(self.faces)}); }} "
+        model_init_calls = [f"{self.name}Model = modelNew({self.name}Verts, {self.vert_shift}, {self.name}Faces, {self.name}FaceIndices, {len(self.verts)}, {len(self.faces)});", f"modelSetVertexNormals(&{self.name}Model, {self.name}VertNormals);", f"modelSetEdges(&{self.name}Model, {self.name}Edges, {len(edges)});"]
+        center, radius = self.bounding_sphere()
+        model_init_calls.append(f"modelSetBoundingSphere(&{self.name}Model, (Vec3){{.x={center[0]},.y={center[1]},.z={center[2]}}}, {radius});")
+        meshlets = self.build_meshlets() # (Reorders the faces, so it comes before anything which is emitted per face.)
+        self.meshlet_summary = self.meshlet_report(meshlets)
+        meshlets_string = ""
+        if meshlets:
+            meshlets_string = f"const Meshlet {self.name}Meshlets[{len(meshlets)}] = {{"
+            for first, count, m_center, m_radius, axis, cutoff in meshlets:
+                meshlets_string += f"{{.firstFace={first},.numFaces={count},.center={{{m_center[0]},{m_center[1]},{m_center[2]}}},.radius={m_radius},.coneAxis={{{axis[0]},{axis[1]},{axis[2]}}},.coneCutoff={cutoff}}}, "
+            meshlets_string += "};"
+            model_init_calls.append(f"modelSetMeshlets(&{self.name}Model, {self.name}Meshlets, {len(meshlets)});")
 
         for i, vert in enumerate(self.verts):
+            vert = [c >> self.vert_shift for c in vert]
             verts_string += f"{{.x={vert[0]},.y={vert[1]},.z={vert[2]}}}, "
         verts_string += "};"
 
+        for normal in self.vertex_normals():
+            vert_normals_string += f"{{.x={normal[0]},.y={normal[1]},.z={normal[2]}}}, "
+        vert_normals_string += "};"
+
         for i, face in enumerate(self.faces):
-            normal = self.normals[face.normal_idx]
+            normal = pack_normal(self.normals[face.normal_idx])
             face_clr = f"{face.color[0] + (face.color[1]<<5) + (face.color[2]<<10)}"
-            faces_string += f"{{.vertexIndex = {{{face.vert_idx[0]}, {face.vert_idx[1]}, {face.vert_idx[2]}}}, .color = {face_clr}, .normal={{{normal[0]}, {normal[1]}, {normal[2]}}}, .type=TriangleFace}}, "
+            face_type = "ConvexPlanarQuadFace" if len(face.vert_idx) == 4 else "TriangleFace"
+            plane_dist = sum((normal[axis] * 2 * self.verts[face.vert_idx[0]][axis]) >> 8 for axis in range(3)) # With the unpacked normal, rounded like vecDot (fxmul shifts, i.e. rounds towards negative infinity).
+            faces_string += f"{{.color = {face_clr}, .normal={{{normal[0]}, {normal[1]}, {normal[2]}}}, .planeDist={plane_dist}, .type={face_type}}}, "
+            indices = face.vert_idx + [0] * (FACE_MAX_VERTS - len(face.vert_idx))
+            if narrow_indices:
+                face_indices_string += f"{hex(indices[0] | indices[1] << 8 | indices[2] << 16 | indices[3] << 24)}, "
+            else:
+                face_indices_string += f"{hex(indices[0] | indices[1] << 16)}, {hex(indices[2] | indices[3] << 16)}, "
         faces_string += "};"
+        face_indices_string += "};"
+
+        for (a, b), color in edges:
+            edges_string += f"{{.vertexIndex = {{{a}, {b}}}, .color = {color[0] + (color[1]<<5) + (color[2]<<10)}}}, "
+        edges_string += "};"
+
+        texture_string = ""
+        if self.texture is not None: # Texels, the texture, and the texture coordinates (FACE_MAX_VERTS per face) in ROM.
+            width, height, rows = self.texture
+            texels = ", ".join(str(rgb2rgb15(*texel)) for row in rows for texel in row)
+            tex_coords = ""
+            for face in self.faces:
+                coords = [self.tex_coords[idx] for idx in face.tex_idx] if len(face.tex_idx) == len(face.vert_idx) else [(0, 0)] * len(face.vert_idx)
+                coords += [(0, 0)] * (FACE_MAX_VERTS - len(coords))
+                tex_coords += "".join(f"{{.u={u},.v={v}}}, " for u, v in coords)
+            texture_string = textwrap.dedent(f"""
+            const COLOR {self.name}Texels[{width * height}] = {{{texels}}};
+            const Texture {self.name}Texture = {{.texels={self.name}Texels, .widthLog2={width.bit_length() - 1}, .heightLog2={height.bit_length() - 1}}};
+            const TexCoord {self.name}TexCoords[{len(self.faces) * FACE_MAX_VERTS}] = {{{tex_coords}}};
+            """)
+            model_init_calls.append(f"modelSetTexture(&{self.name}Model, &{self.name}Texture, {self.name}TexCoords);")
+        data = "\n\n".join([model_string, verts_string, vert_normals_string, faces_string, face_indices_string, edges_string] + ([meshlets_string] if meshlets_string else [])) + "\n" + texture_string
+        return data, model_init_calls
 
-        data_file = textwrap.dedent(f"""
-        #include "{self.name}Model.h"
-
-        {model_string}
-
-        {verts_string}
+    def generate_code(self) ->Dict:
+        # Header file: 
+        header_file = textwrap.dedent(f"""
+        #ifndef {self.name}Model_H
+        #define {self.name}Model_H
+        #include "../source/model.h"
 
-        {faces_string}
+        extern Model {self.name}Model;
+        void {self.name}ModelInit(void);
 
-        {model_initfun}
+        #endif
         """)
+        # Implementation/data file:
+        data, model_init_calls = self.generate_data()
+        # The LODs (cf. load_lods) go into the same file. The model is switched to its next LOD beyond LOD_SWITCH_RADII times its radius per level (cf. modelSetLod).
+        radius = self.bounding_sphere()[1]
+        chain = [self] + self.lods
+        for level, lod in enumerate(self.lods, start=1):
+            lod_data, lod_init_calls = lod.generate_data()
+            data += "\n" + lod_data
+            model_init_calls += lod_init_calls
+            model_init_calls.append(f"modelSetLod(&{chain[level - 1].name}Model, &{lod.name}Model, {radius * LOD_SWITCH_RADII * level});")
+        model_initfun = f"void {self.name}ModelInit(void) {{ {' '.join(model_init_calls)} }} "
+
+        data_file = "\n".join(["", f'#include "{self.name}Model.h"', "", data, model_initfun, ""])
         return {self.name + "Model.h": header_file, self.name + "Model.c": data_file}
+
+    def load_lods(self):
+        """ 
+        Hand-authored levels of detail: name_lod1.obj, name_lod2.obj etc. next to name.obj (each one should have fewer faces than the one before). 
+        If a LOD doesn't have a .mtl file of its own, it uses the one of the model. 
+        """
+        self.lods = []
+        while True:
+            lod_file = self.input_filename.with_name(f"{self.input_filename.stem}_lod{len(self.lods) + 1}.obj")
+            if not lod_file.exists():
+                break
+            mtl_file = lod_file.with_suffix(".mtl") if lod_file.with_suffix(".mtl").exists() else self.mtl_file
+            self.lods.append(Model(lod_file, self.max_model_verts, self.max_model_faces, self.max_model_edges, self.merge_quads, name=f"{self.name}Lod{len(self.lods) + 1}", mtl_file=mtl_file))
        
 
 def read_model_limits():
-    """ Reads MAX_MODEL_VERTS and MAX_MODEL_FACES from source/model.h """
+    """ Reads MAX_MODEL_VERTS, MAX_MODEL_FACES and MAX_MODEL_EDGES from source/model.h """
     model_h_path = pathlib.Path(".").joinpath(SOURCE_DIR).joinpath("model.h")
     if not model_h_path.exists:
         raise ValueError(f"'{model_h_path.name}' not found (needed to get the MAX_MODEL_VERTS/FACES).")
     MAX_MODEL_VERTS: int
     MAX_MODEL_FACES: int
+    MAX_MODEL_EDGES: int
 
     with open(model_h_path) as file:
         code = file.read()
@@ -195,18 +666,37 @@ def read_model_limits():
             MAX_MODEL_FACES = int(match.group(1))
         else: 
             raise ValueError(f"'{model_h_path.name}' does not define MAX_MODEL_FACES.")
+        match = re.search(r"\#define\s+MAX_MODEL_EDGES\s+(\d+)", code)
+        if match:
+            MAX_MODEL_EDGES = int(match.group(1))
+        else: 
+            raise ValueError(f"'{model_h_path.name}' does not define MAX_MODEL_EDGES.")
 
-    return (MAX_MODEL_VERTS, MAX_MODEL_FACES)
+    return (MAX_MODEL_VERTS, MAX_MODEL_FACES, MAX_MODEL_EDGES)
 
 
+FACE_MAX_VERTS = 4 # Has to match FACE_MAX_VERTS in source/model.h
+MODEL_MAX_NARROW_VERTS = 256 # Has to match MODEL_MAX_NARROW_VERTS in source/model.h
+LOD_SWITCH_RADII = 12 # At that distance, the bounding sphere of a model covers about a fifth of the height of the canvas (with CAMERA_VERTICAL_FOV_43_DEG).
+MESHLET_MAX_FACES = 48 # Models with more faces are split into meshlets (cf. Meshlet in source/model.h).
+MESHLET_MIN_FACES = 6 # Smaller meshlets are merged into a neighbouring one (cf. Model.merge_small_meshlets) ...
+MESHLET_MERGED_MAX_FACES = 64 # ... as long as it doesn't get bigger than this.
+MESHLET_MIN_NORMAL_DOT = 0.8 # The normals of the faces of a meshlet are within about 37 degrees of the one of its first face (before merging).
+MESHLET_MAX_SEED_DIST = 0.5 # Nor are its faces further from its first one than this (relative to the radius of the model).
+MESHLET_NORMAL_WEIGHT = 2 # How much a different normal counts against a face joining a meshlet, compared to its distance (relative to the size of the model).
+MESHLET_CONE_SLACK = 0.02 # Radians added to the opening angle of the normal cones, for the rounding of the normals and axes to fixed point.
+LOD_FILE_PATTERN = re.compile(r"_lod\d+$") # name_lod1.obj etc. are levels of detail of name.obj (cf. Model.load_lods), not models of their own.
+
 # With respect to the project directory.
 SOURCE_DIR = "source/"
 MODEL_DIR = "assets/models/"
 OUT_DIR_DATA = "data-models/"
 
 if __name__ == "__main__":
-    MAX_MODEL_VERTS, MAX_MODEL_FACES = read_model_limits()
-    models = [Model(filepath, max_model_verts=MAX_MODEL_VERTS, max_model_faces=MAX_MODEL_FACES) for filepath in pathlib.Path(".").joinpath(MODEL_DIR).glob("*.obj")]
+    MAX_MODEL_VERTS, MAX_MODEL_FACES, MAX_MODEL_EDGES = read_model_limits()
+    models = [Model(filepath, max_model_verts=MAX_MODEL_VERTS, max_model_faces=MAX_MODEL_FACES, max_model_edges=MAX_MODEL_EDGES) for filepath in pathlib.Path(".").joinpath(MODEL_DIR).glob("*.obj") if not LOD_FILE_PATTERN.search(filepath.stem)]
+    for model in models:
+        model.load_lods()
 
     modelsWritten = 0
     infile_paths = [str(model.input_filename.relative_to(pathlib.Path("."))) for model in models]
@@ -228,6 +718,7 @@ if __name__ == "__main__":
         print("Nothing to be done.")
     elif modelsWritten >= len(models):
         print(f"In:\t{' '.join(infile_paths)}\nOut:\t{' '.join(outfile_paths)}")
+        print("\n".join(lod.meshlet_summary for model in models for lod in [model] + model.lods))
         print(f"Converted all models {OKGREEN}(Success){END}")
     elif modelsWritten > 0 and modelsWritten < len(models):
         print(f"In:\t{' '.join(infile_paths)}\nOut:\t{' '.join(outfile_paths)}")